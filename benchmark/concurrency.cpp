@@ -0,0 +1,79 @@
+/*
+ * Measures how MDD operations on a single MDD_THREAD_SAFE factory scale with the number
+ * of threads. Every thread builds its own sets and combines them with a shared set, so
+ * that threads contend on the unique table, the operation cache and the arena, but not on
+ * each other's results. The total amount of work is the same for every thread count.
+ *
+ * Usage: mdd_bench_mt [max_threads] [rounds]
+ */
+
+#ifndef MDD_THREAD_SAFE
+#error "This benchmark must be compiled with MDD_THREAD_SAFE"
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "mdd.h"
+
+namespace
+{
+
+mdd::mdd<int> make_set(mdd::mdd_factory<int>& factory, int seed, int size)
+{
+    mdd::mdd<int> result = factory.empty_set();
+    for (int i = 0; i < size; ++i)
+    {
+        int v[4] = { (i + seed) % 7, (i * 3 + seed) % 13, i % 17, i + seed };
+        result.add_in_place(v, v + 4);
+    }
+    return result;
+}
+
+double run(unsigned threads, int rounds)
+{
+    mdd::mdd_factory<int> factory;
+    mdd::mdd<int> shared = make_set(factory, 0, 2000);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&, t]()
+        {
+            for (int round = t; round < rounds; round += threads)
+            {
+                mdd::mdd<int> own = make_set(factory, round * 1000 + 1, 1000);
+                mdd::mdd<int> result = (own | shared) - (own & shared);
+                if (result == factory.empty_set())
+                    std::abort();
+            }
+        }));
+    }
+    for (auto& worker: workers)
+        worker.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    unsigned max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 256;
+    if (max_threads == 0)
+        max_threads = 1;
+
+    std::cout << "threads\tseconds\tspeedup" << std::endl;
+    double single = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        double seconds = run(threads, rounds);
+        if (threads == 1)
+            single = seconds;
+        std::cout << threads << "\t" << seconds << "\t" << single / seconds << std::endl;
+    }
+    return 0;
+}
@@ -4,22 +4,39 @@
 #include <mdd_iterator.h>
 #include <mdd_factory.h>
 
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
 #include "utilities/zip.h"
 #include "utilities/concat.h"
 
 #include "operations/add_element.h"
+#include "operations/remove_element.h"
+#include "operations/remove_sorted.h"
 #include "operations/set_count.h"
+#include "operations/set_rank.h"
+#include "operations/set_sample.h"
 #include "operations/set_dot.h"
+#include "operations/set_export.h"
+#include "operations/set_for_each.h"
 #include "operations/set_project.h"
 #include "operations/set_union.h"
 #include "operations/set_minus.h"
 #include "operations/set_intersect.h"
 #include "operations/set_contains.h"
 #include "operations/set_match_proj.h"
+#include "operations/set_from_sorted.h"
 #include "operations/rel_composition.h"
+#include "operations/rel_for_each.h"
 #include "operations/rel_relabel.h"
 #include "operations/rel_next.h"
+#include "operations/rel_next_union.h"
+#include "operations/rel_next_minus.h"
 #include "operations/rel_prev.h"
+#include "operations/rel_saturate.h"
+#include "operations/rel_next_multi.h"
 
 // TODO: remove
 #include <iostream>
@@ -71,13 +88,18 @@ int main(int argc, char** argv)
 a
 a b
 \endverbatim
+ *
+ * When the library is compiled with MDD_MARK_SWEEP, every mdd::mdd registers itself as a
+ * garbage collection root with its factory for as long as it exists.
  */
 template <typename Value>
-class mdd
+class mdd : private node_factory<Value>::root
 {
 public:
     friend class mdd_factory<Value>;
     friend class node_factory<Value>;
+    friend class mdd_inserter<Value>;
+    friend class reachability<Value>;
 
     typedef mdd_iterator<Value> iterator;
     typedef mdd_iterator<Value> const_iterator;
@@ -88,9 +110,23 @@ public:
     typedef factory_type* factory_ptr;
     typedef typename mdd_factory<Value>::node_ptr node_ptr;
 protected:
+    typedef typename node_factory<Value>::root root;
+
     factory_ptr m_factory;
     node_ptr m_node;
 
+    /**
+     * @brief Applies \p Functor to the node of this MDD.
+     * @return The node returned by the functor, which is owned by the caller.
+     */
+    template<typename Functor, typename... Args>
+    inline
+    node_ptr invoke(Args&&... args) const
+    {
+        typename node_factory<Value>::operation guard(*m_factory);
+        return Functor(*m_factory)(m_node, std::forward<Args>(args)...);
+    }
+
     inline
     factory_ptr get_factory(const mdd_type& other) const
     {
@@ -117,27 +153,30 @@ protected:
 public:
 
     mdd(factory_ptr factory, node_ptr node)
-        : m_factory(factory), m_node(node)
-    {}
+        : root(*factory, &m_node), m_factory(factory), m_node(node)
+    {
+        m_factory->safe_point();
+    }
 
     mdd(factory_ptr factory)
-        : m_factory(factory), m_node(factory->empty())
+        : root(*factory, &m_node), m_factory(factory), m_node(factory->empty())
     {}
 
     template<typename Functor, typename... Args>
     inline
     mdd_type apply(Args... args) const
     {
-        return mdd_type(m_factory, Functor(*m_factory)(m_node, args...));
+        return mdd_type(m_factory, invoke<Functor>(args...));
     }
 
     template<typename Functor, typename... Args>
     inline
     mdd_type& apply_in_place(Args... args)
     {
-        node_ptr newnode = Functor(*m_factory)(m_node, args...);
+        node_ptr newnode = invoke<Functor>(args...);
         m_node->unuse();
         m_node = newnode;
+        m_factory->safe_point();
         return *this;
     }
 
@@ -151,7 +190,7 @@ public:
      * @param other The mdd to copy.
      */
     mdd(const mdd_type& other)
-        : m_factory(other.m_factory)
+        : root(*other.m_factory, &m_node), m_factory(other.m_factory)
     {
         m_node = other.m_node->use();
     }
@@ -253,6 +292,46 @@ m += v;    // efficient
     mdd_type& add_in_place(iterator begin, iterator end)
     { return apply_in_place<typename factory_type::mdd_add_element>(begin, end); }
 
+    /**
+     * @brief Removes a vector from the MDD.
+     * @param begin Iterator to the first element of the vector.
+     * @param end Iterator past the last element of the vector.
+     * @return The mdd without the vector [\p begin, \p end).
+     */
+    template <typename iterator>
+    mdd_type remove(iterator begin, iterator end) const
+    { return apply<typename factory_type::mdd_remove_element>(begin, end); }
+
+    /**
+     * @brief Efficient removal.
+     * @see remove()
+     */
+    template <typename iterator>
+    mdd_type& remove_in_place(iterator begin, iterator end)
+    { return apply_in_place<typename factory_type::mdd_remove_element>(begin, end); }
+
+    /**
+     * @brief Removes a batch of vectors from the MDD. This is much faster than removing
+     *        the vectors one by one, or subtracting an MDD that contains them.
+     * @param begin Iterator to the first vector. Vectors can be of any type that has
+     *        begin() and end() methods.
+     * @param end Iterator past the last vector.
+     * @return The mdd without the vectors in [\p begin, \p end).
+     * @throw std::runtime_error if the vectors are not sorted lexicographically (as by
+     *        std::lexicographical_compare). Duplicates are allowed.
+     */
+    template <typename iterator>
+    mdd_type remove_all(iterator begin, iterator end) const
+    { return apply<typename factory_type::mdd_remove_sorted>(begin, end); }
+
+    /**
+     * @brief Efficient batch removal.
+     * @see remove_all()
+     */
+    template <typename iterator>
+    mdd_type& remove_all_in_place(iterator begin, iterator end)
+    { return apply_in_place<typename factory_type::mdd_remove_sorted>(begin, end); }
+
     bool operator==(const mdd_type& other) const
     {
         assert(m_factory == other.m_factory);
@@ -269,7 +348,87 @@ m += v;    // efficient
     { return iterator(m_factory, m_node); }
 
     iterator end() const
-    { return iterator(m_factory); }
+    { return iterator(m_factory, m_node, true); }
+
+    /**
+     * @brief Returns an iterator to the first vector that does not come before
+     *        [\p begin, \p end), in the order in which begin() enumerates the MDD. For
+     *        sets of vectors of equal length, this is lexicographic order.
+     */
+    template <typename value_iterator>
+    iterator lower_bound(value_iterator begin, value_iterator end) const
+    {
+        iterator result(this->end());
+        result.seek(begin, end);
+        return result;
+    }
+
+    /**
+     * @brief Returns an iterator to the first vector that comes after [\p begin, \p end).
+     * @see lower_bound()
+     */
+    template <typename value_iterator>
+    iterator upper_bound(value_iterator begin, value_iterator end) const
+    {
+        iterator result = lower_bound(begin, end);
+        if (result != this->end() && std::distance(begin, end) == (ptrdiff_t)(*result).size() &&
+            std::equal(begin, end, (*result).begin()))
+            ++result;
+        return result;
+    }
+
+    /**
+     * @brief Calls \p element for every vector in the MDD, in the order in which begin()
+     *        enumerates them. This is considerably faster than using iterators.
+     * @param element Callback that takes a const std::vector<Value>& and returns false to
+     *        end the enumeration. The vector is only valid during the call.
+     * @return False if the enumeration was ended by \p element, true otherwise.
+     */
+    template <typename ElementCallback>
+    bool for_each(ElementCallback element) const
+    {
+        typename factory_type::mdd_set_for_each::visit_all prefix;
+        return for_each(element, prefix);
+    }
+
+    /**
+     * @brief Calls \p element for every vector in the MDD, and allows parts of the MDD to
+     *        be skipped.
+     * @param element Callback that takes a const std::vector<Value>& and returns false to
+     *        end the enumeration.
+     * @param prefix Callback that is called with every non-empty prefix of the vectors in
+     *        the MDD before the vectors that start with it are visited. It returns a
+     *        visit_action that tells whether to visit or skip these vectors, or to end the
+     *        enumeration.
+     * @return False if the enumeration was ended by one of the callbacks, true otherwise.
+     */
+    template <typename ElementCallback, typename PrefixCallback>
+    bool for_each(ElementCallback element, PrefixCallback prefix) const
+    {
+        mdd_type pin(*this);
+        return typename factory_type::mdd_set_for_each(*m_factory)(m_node, element, prefix);
+    }
+
+    /**
+     * @brief Writes all vectors in the MDD to a flat array, in the order in which begin()
+     *        enumerates them. All vectors must have the same length.
+     * @param out The array to write to.
+     * @param capacity The number of elements that fit in \p out.
+     * @param layout Whether to write the vectors as rows (out[row * length + column]) or
+     *        as columns (out[column * rows + row]).
+     * @param threads The number of threads to use. The threads only read the MDD, and
+     *        write to disjoint parts of \p out.
+     * @return The number of vectors written.
+     * @throw std::length_error if \p out cannot hold all vectors.
+     * @throw std::runtime_error if not all vectors have the same length. The contents of
+     *        \p out are unspecified in that case.
+     */
+    size_t export_columns(Value* out, size_t capacity, export_layout layout = export_row_major,
+                          unsigned threads = 1) const
+    {
+        mdd_type pin(*this);
+        return typename factory_type::mdd_set_export(*m_factory)(m_node, out, capacity, layout, threads);
+    }
 
     uintptr_t id() const
     { return (uintptr_t)m_node; }
@@ -303,6 +462,72 @@ m += v;    // efficient
         return apply<typename factory_type::mdd_set_project>(projection);
     }
 
+    /**
+     * @brief Returns the states reachable from this set in one step of any of \p partitions,
+     *        each of which is an interleaved relation over the levels of its projection.
+     *
+     * The set is walked once for all partitions (see node_factory::mdd_rel_next_multi),
+     * which is much faster than merging the images of the partitions one by one when
+     * there are many of them.
+     */
+    mdd_type next(const std::vector<std::pair<mdd_irel<Value>, projection> >& partitions) const
+    {
+        typedef typename factory_type::mdd_rel_next_multi next_multi;
+        typedef typename std::vector<std::pair<mdd_irel<Value>, projection> >::value_type element;
+        auto sorted = next_multi::sort_partitions(partitions.begin(), partitions.end(), [this](const element& e) {
+            assert(m_factory == get_factory(e.first));
+            return std::pair<node_ptr, const projection*>(get_node(e.first), &e.second);
+        });
+        return apply<next_multi>(sorted);
+    }
+
+    /**
+     * @brief Returns the exact number of vectors in the MDD.
+     * @see path_count
+     */
+    path_count count() const
+    {
+        return typename factory_type::mdd_set_count(*m_factory).exact(m_node);
+    }
+
+    /**
+     * @brief Returns the vector at position \p index, in the order in which begin()
+     *        enumerates the MDD.
+     *
+     * Together with rank(), this allows the MDD to be split into ranges of positions that
+     * can be processed independently, without enumerating it.
+     * @throw std::out_of_range if \p index is not below count().
+     */
+    std::vector<Value> at(path_count index) const
+    {
+        return typename factory_type::mdd_set_rank(*m_factory).at(m_node, index);
+    }
+
+    /**
+     * @brief Returns the number of vectors in the MDD that come before [\p begin, \p end)
+     *        in the order in which begin() enumerates the MDD. If the vector is in the MDD,
+     *        this is its position, so that at(rank(begin, end)) is the vector itself.
+     */
+    template <typename iterator>
+    path_count rank(iterator begin, iterator end) const
+    {
+        return typename factory_type::mdd_set_rank(*m_factory).rank(m_node, begin, end);
+    }
+
+    /**
+     * @brief Draws \p k vectors uniformly at random (with replacement) from the MDD,
+     *        without enumerating it.
+     * @param rng A uniform random bit generator, such as std::mt19937_64.
+     * @param k The number of vectors to draw.
+     * @throw std::runtime_error if the MDD is empty.
+     * @throw std::overflow_error if count() does not fit in a path_count.
+     */
+    template <typename Rng>
+    std::vector<std::vector<Value> > sample(Rng& rng, size_t k) const
+    {
+        return typename factory_type::mdd_set_sample(*m_factory)(m_node, rng, k);
+    }
+
     double size()
     {
         return typename factory_type::mdd_set_count(*m_factory)(m_node);
@@ -339,6 +564,14 @@ public:
     typedef typename parent::factory_ptr factory_ptr;
     typedef typename parent::node_ptr node_ptr;
 
+    /**
+     * @brief Copy constructor.
+     * @param other The mdd to copy.
+     */
+    mdd_irel(const mdd_type& other)
+        : parent(other)
+    {}
+
     /**
      * @brief Assignment
      * @param other The mdd to copy.
@@ -356,16 +589,17 @@ public:
     inline
     mdd_type apply(Args... args) const
     {
-        return mdd_type(parent::m_factory, Functor(*parent::m_factory)(parent::m_node, args...));
+        return mdd_type(parent::m_factory, this->template invoke<Functor>(args...));
     }
 
     template<typename Functor, typename... Args>
     inline
     mdd_type& apply_in_place(Args... args)
     {
-        node_ptr newnode = Functor(*parent::m_factory)(parent::m_node, args...);
+        node_ptr newnode = this->template invoke<Functor>(args...);
         parent::m_node->unuse();
         parent::m_node = newnode;
+        parent::m_factory->safe_point();
         return *this;
     }
 
@@ -388,7 +622,7 @@ public:
     mdd_srel<Value> compose(const mdd_srel<Value>& other)
     {
         assert(parent::m_factory == parent::get_factory(other));
-        return mdd_srel<Value>(parent::m_factory, typename factory_type::mdd_rel_composition(*parent::m_factory)(parent::m_node, parent::get_node(other), factory_type::mdd_rel_composition::interleaved_sequential));
+        return mdd_srel<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_composition>(parent::get_node(other), factory_type::mdd_rel_composition::interleaved_sequential));
     }
 
     /**
@@ -410,17 +644,66 @@ public:
 
     mdd<Value> operator()(const mdd<Value>& s)
     {
-        return mdd<Value>(parent::m_factory, typename factory_type::mdd_rel_next(*parent::m_factory)(parent::m_node, parent::get_node(s)));
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_next>(parent::get_node(s)));
     }
 
     mdd<Value> operator()(const mdd<Value>& s, projection& proj)
     {
-        return mdd<Value>(parent::m_factory, typename factory_type::mdd_rel_next(*parent::m_factory)(parent::m_node, parent::get_node(s), proj));
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_next>(parent::get_node(s), proj));
+    }
+
+    /**
+     * @brief Computes \p visited | (*this)(\p s) in a single traversal, without building
+     *        the image of \p s as an intermediate MDD.
+     */
+    mdd<Value> next_union(const mdd<Value>& s, const mdd<Value>& visited)
+    {
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_next_union>(parent::get_node(s), parent::get_node(visited)));
+    }
+
+    mdd<Value> next_union(const mdd<Value>& s, const mdd<Value>& visited, projection& proj)
+    {
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_next_union>(parent::get_node(s), parent::get_node(visited), proj));
+    }
+
+    /**
+     * @brief Computes (*this)(\p s) - \p visited in a single traversal, without building
+     *        the image of \p s as an intermediate MDD.
+     */
+    mdd<Value> next_minus(const mdd<Value>& s, const mdd<Value>& visited)
+    {
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_next_minus>(parent::get_node(s), parent::get_node(visited)));
+    }
+
+    mdd<Value> next_minus(const mdd<Value>& s, const mdd<Value>& visited, projection& proj)
+    {
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_next_minus>(parent::get_node(s), parent::get_node(visited), proj));
     }
 
     mdd<Value> pre(const mdd<Value>& s)
     {
-        return mdd<Value>(parent::m_factory, typename factory_type::mdd_rel_prev(*parent::m_factory)(parent::m_node, parent::get_node(s)));
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_prev>(parent::get_node(s)));
+    }
+
+    mdd<Value> pre(const mdd<Value>& s, const projection& proj)
+    {
+        return mdd<Value>(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_prev>(parent::get_node(s), proj));
+    }
+
+    /**
+     * @brief Calls \p pair for every pair in the relation, with the source and target
+     *        vectors separated. For a relation built over a projection, the vectors only
+     *        contain the projected levels.
+     * @param pair Callback that takes two const std::vector<Value>& (source and target),
+     *        and returns false to end the enumeration. The vectors are only valid during
+     *        the call.
+     * @return False if the enumeration was ended by \p pair, true otherwise.
+     */
+    template <typename PairCallback>
+    bool for_each_pair(PairCallback pair) const
+    {
+        mdd_type pin(*this);
+        return typename factory_type::mdd_rel_for_each(*parent::m_factory)(parent::m_node, pair);
     }
 
     /**
@@ -492,6 +775,14 @@ public:
     typedef typename parent::factory_ptr factory_ptr;
     typedef typename parent::node_ptr node_ptr;
 
+    /**
+     * @brief Copy constructor.
+     * @param other The mdd to copy.
+     */
+    mdd_srel(const mdd_type& other)
+        : parent(other)
+    {}
+
     /**
      * @brief Assignment
      * @param other The mdd to copy.
@@ -509,16 +800,17 @@ public:
     inline
     mdd_type apply(Args... args) const
     {
-        return mdd_type(parent::m_factory, Functor(*parent::m_factory)(parent::m_node, args...));
+        return mdd_type(parent::m_factory, this->template invoke<Functor>(args...));
     }
 
     template<typename Functor, typename... Args>
     inline
     mdd_type& apply_in_place(Args... args)
     {
-        node_ptr newnode = Functor(*parent::m_factory)(parent::m_node, args...);
+        node_ptr newnode = this->template invoke<Functor>(args...);
         parent::m_node->unuse();
         parent::m_node = newnode;
+        parent::m_factory->safe_point();
         return *this;
     }
 
@@ -540,7 +832,7 @@ public:
     template <typename relabeler>
     mdd_type relabel(relabeler& l)
     {
-        return mdd_type(parent::m_factory, typename factory_type::mdd_rel_relabel(*parent::m_factory)(parent::m_node, l));
+        return mdd_type(parent::m_factory, this->template invoke<typename factory_type::mdd_rel_relabel>(l));
     }
 
     /**
@@ -12,6 +12,10 @@ template <typename Value>
 class mdd_irel;
 template <typename Value>
 class mdd_srel;
+template <typename Value>
+class mdd_inserter;
+template <typename Value>
+class reachability;
 
 template <typename Value>
 class mdd_factory : protected node_factory<Value>
@@ -25,6 +29,7 @@ public:
     using typename parent::cache_type;
     using typename parent::node_type;
     using typename parent::node_ptr;
+    using typename parent::memory_policy;
 
     friend class mdd<Value>;
     friend class mdd_irel<Value>;
@@ -35,7 +40,23 @@ public:
     using parent::clean;
     using parent::cache_hits;
     using parent::cache_misses;
+    using parent::cache_capacity;
     using parent::clear_cache;
+    using parent::node_bytes;
+    using parent::bytes;
+    using parent::policy;
+#ifdef MDD_MARK_SWEEP
+    using parent::gc_threshold;
+#endif
+
+    /**
+     * @brief Constructor.
+     * @param policy The memory management policy of the factory.
+     * @param cache The configuration of the operation cache.
+     */
+    mdd_factory(const memory_policy& policy = memory_policy(), const cache_config& cache = cache_config())
+        : parent(policy, cache)
+    { }
 
     /**
      * @brief Returns an empty MDD.
@@ -61,6 +82,27 @@ public:
      */
     set_type singleton_set() { return set_type(this, parent::emptylist()); }
 
+    /**
+     * @brief Builds an MDD from a range of vectors in a single pass. This is much faster
+     *        than adding the vectors one by one.
+     * @param begin Iterator to the first vector. Vectors can be of any type that has
+     *        begin() and end() methods.
+     * @param end Iterator past the last vector.
+     * @return An mdd::mdd containing the vectors in [\p begin, \p end).
+     * @throw std::runtime_error if the vectors are not sorted lexicographically (as by
+     *        std::lexicographical_compare). Duplicates are allowed.
+     */
+    template <typename iterator>
+    set_type from_sorted(iterator begin, iterator end)
+    {
+        node_ptr result;
+        {
+            typename parent::operation guard(*this);
+            result = typename parent::mdd_set_from_sorted(*this)(begin, end);
+        }
+        return set_type(this, result);
+    }
+
     // For debugging purposes:
     void print_nodes(std::ostream& s)
     {
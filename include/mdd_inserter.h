@@ -0,0 +1,146 @@
+#ifndef __scranen_mdd_mdd_inserter_h
+#define __scranen_mdd_mdd_inserter_h
+
+#include <algorithm>
+#include <vector>
+
+#include "mdd.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Buffers vectors that are added to an MDD, and adds them in batches.
+ *
+ * Adding vectors one at a time with mdd::add_in_place() rebuilds the path from the root to
+ * the new leaf for every vector. An inserter instead stores incoming vectors in a flat
+ * buffer. Once the buffer holds \p threshold vectors, they are sorted, built into a single
+ * MDD with mdd_factory::from_sorted(), and merged into the target with one union.
+ *
+ * The buffer is flushed when the inserter is destroyed. Errors (such as
+ * mdd::budget_exceeded) that occur while merging are then ignored, and the buffered vectors
+ * are lost. Call flush() explicitly to handle them.
+ *
+ * Example usage:
+ * \code
+ * mdd::mdd_factory<int> factory;
+ * mdd::mdd<int> m = factory.empty_set();
+ * {
+ *     mdd::mdd_inserter<int> inserter(m);
+ *     for (auto& v : vectors)
+ *         inserter += v;
+ * }
+ * \endcode
+ */
+template <typename Value>
+class mdd_inserter
+{
+public:
+    typedef mdd<Value> mdd_type;
+    typedef size_t size_type;
+
+    /**
+     * @brief Constructor.
+     * @param target The MDD to which the vectors are added.
+     * @param threshold The number of vectors that are buffered before they are added to
+     *        \p target.
+     */
+    mdd_inserter(mdd_type& target, size_type threshold = 1 << 14)
+        : m_target(target), m_threshold(threshold ? threshold : 1)
+    { }
+
+    mdd_inserter(const mdd_inserter&) = delete;
+    mdd_inserter& operator=(const mdd_inserter&) = delete;
+
+    ~mdd_inserter()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /**
+     * @brief Adds the vector [\p begin, \p end) to the buffer.
+     */
+    template <typename iterator>
+    void insert(iterator begin, iterator end)
+    {
+        m_offsets.push_back(m_values.size());
+        m_values.insert(m_values.end(), begin, end);
+        if (m_offsets.size() >= m_threshold)
+            flush();
+    }
+
+    /**
+     * @brief Adds \p list to the buffer.
+     */
+    template <typename iterable>
+    mdd_inserter& operator+=(const iterable& list)
+    {
+        insert(list.begin(), list.end());
+        return *this;
+    }
+
+    /**
+     * @brief Adds all buffered vectors to the target MDD.
+     */
+    void flush()
+    {
+        if (m_offsets.empty())
+            return;
+        std::vector<range> ranges;
+        ranges.reserve(m_offsets.size());
+        for (size_type i = 0; i < m_offsets.size(); ++i)
+        {
+            size_type end = i + 1 < m_offsets.size() ? m_offsets[i + 1] : m_values.size();
+            ranges.push_back(range(m_values.begin() + m_offsets[i], m_values.begin() + end));
+        }
+        std::sort(ranges.begin(), ranges.end());
+        mdd_type batch = m_target.m_factory->from_sorted(ranges.begin(), ranges.end());
+        m_values.clear();
+        m_offsets.clear();
+        m_target |= batch;
+    }
+
+    /**
+     * @brief Returns the number of vectors in the buffer.
+     */
+    size_type pending() const
+    {
+        return m_offsets.size();
+    }
+private:
+    // Iterators rather than pointers, as std::vector<bool> does not store bools.
+    typedef typename std::vector<Value>::const_iterator value_iterator;
+
+    struct range
+    {
+        value_iterator first;
+        value_iterator last;
+
+        range(value_iterator first, value_iterator last)
+            : first(first), last(last)
+        { }
+
+        value_iterator begin() const { return first; }
+        value_iterator end() const { return last; }
+
+        bool operator<(const range& other) const
+        {
+            return std::lexicographical_compare(first, last, other.first, other.last);
+        }
+    };
+
+    mdd_type& m_target;
+    size_type m_threshold;
+    std::vector<Value> m_values;
+    std::vector<size_type> m_offsets;
+};
+
+} // namespace mdd
+
+#endif // __scranen_mdd_mdd_inserter_h
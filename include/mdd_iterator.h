@@ -1,7 +1,6 @@
 #ifndef __scranen_mdd_iterator_h
 #define __scranen_mdd_iterator_h
 
-#include <stack>
 #include <stdexcept>
 #include <vector>
 #include <iterator>
@@ -11,29 +10,77 @@
 namespace mdd
 {
 
+/**
+ * @brief Bidirectional iterator over the vectors in an MDD.
+ *
+ * The iterator keeps the path from the root to the current vector. Vectors are enumerated
+ * in lexicographic order, except that a vector comes after the vectors it is a proper
+ * prefix of. Moving backwards has to find the predecessor of a node in its sibling list,
+ * so it takes time proportional to the size of the sibling lists involved.
+ */
 template <typename Value>
-class mdd_iterator : public std::iterator<std::input_iterator_tag, Value>
+class mdd_iterator : public std::iterator<std::bidirectional_iterator_tag, std::vector<Value>, ptrdiff_t,
+                                          const std::vector<Value>*, const std::vector<Value>&>
 {
 public:
     typedef std::vector<Value> vector_type;
     typedef node_factory<Value>* factory_ptr;
     typedef const node<Value>* node_ptr;
 
-    mdd_iterator(factory_ptr factory, node_ptr node)
-        : m_factory(factory)
+    /**
+     * @brief Constructs an iterator pointing to the first vector in \p node, or to the
+     *        end if \p at_end is true.
+     */
+    mdd_iterator(factory_ptr factory, node_ptr node, bool at_end = false)
+        : m_factory(factory), m_root(node)
     {
-        m_stack.push(node);
+        if (at_end)
+            return;
+        m_stack.push_back(node);
         saturate();
     }
 
+    /**
+     * @brief Constructs an end iterator that cannot be decremented.
+     */
     mdd_iterator(factory_ptr factory)
-        : m_factory(factory)
+        : m_factory(factory), m_root(nullptr)
     { }
 
     mdd_iterator(const mdd_iterator& other)
-        : m_stack(other.m_stack), m_vector(other.m_vector), m_factory(other.m_factory)
+        : m_stack(other.m_stack), m_vector(other.m_vector), m_factory(other.m_factory), m_root(other.m_root)
     { }
 
+    /**
+     * @brief Positions the iterator at the first vector in the MDD that does not come
+     *        before [\p begin, \p end).
+     */
+    template <typename iterator>
+    void seek(iterator begin, const iterator& end)
+    {
+        m_stack.clear();
+        m_vector.clear();
+        node_ptr p = m_root;
+        for (; begin != end; ++begin)
+        {
+            while (!p->sentinel() && p->value < *begin)
+                p = p->right;
+            if (p->sentinel() || !(p->value == *begin))
+                break;
+            m_stack.push_back(p);
+            m_vector.push_back(p->value);
+            p = p->down;
+        }
+        // If the vector was found, its extensions come before it, so only the end of the
+        // sibling list is left. Otherwise, p and everything after it (including the vector
+        // formed by the path to p, which is a proper prefix) come after the vector.
+        if (begin == end)
+            while (!p->sentinel())
+                p = p->right;
+        m_stack.push_back(p);
+        saturate();
+    }
+
     const vector_type& operator*() const
     {
         if (m_stack.empty())
@@ -43,7 +90,7 @@ public:
 
     mdd_iterator<Value>& operator++()
     {
-        m_stack.pop();
+        m_stack.pop_back();
         next();
         saturate();
         return *this;
@@ -52,15 +99,29 @@ public:
     mdd_iterator<Value> operator++(int)
     {
         mdd_iterator<Value> result(*this);
-        m_stack.pop();
+        m_stack.pop_back();
         next();
         saturate();
         return result;
     }
 
+    mdd_iterator<Value>& operator--()
+    {
+        previous();
+        return *this;
+    }
+
+    mdd_iterator<Value> operator--(int)
+    {
+        mdd_iterator<Value> result(*this);
+        previous();
+        return result;
+    }
+
     bool operator==(const mdd_iterator<Value>& other) const
     {
-        return m_stack == other.m_stack && m_factory == other.m_factory && m_vector == other.m_vector;
+        // The vector is determined by the stack, so it need not be compared.
+        return m_stack == other.m_stack && m_factory == other.m_factory;
     }
 
     bool operator!=(const mdd_iterator<Value>& other) const
@@ -74,25 +135,25 @@ private:
         bool done = m_stack.empty();
         while (!done)
         {
-            if (m_stack.top()->sentinel())
+            if (m_stack.back()->sentinel())
             {
-                if (m_stack.top() == m_factory->empty())
+                if (m_stack.back() == m_factory->empty())
                 {
-                    m_stack.pop();
+                    m_stack.pop_back();
                     if (m_stack.empty())
                         done = true;
                     else
                         next();
                 }
-                else // m_stack.top() == m_factory.emptylist()
+                else // m_stack.back() == m_factory.emptylist()
                 {
                     done = true;
                 }
             }
             else
             {
-                m_vector.push_back(m_stack.top()->value);
-                m_stack.push(m_stack.top()->down);
+                m_vector.push_back(m_stack.back()->value);
+                m_stack.push_back(m_stack.back()->down);
             }
         }
     }
@@ -105,16 +166,69 @@ private:
         }
         else
         {
-            node_ptr newtop = m_stack.top()->right;
-            m_stack.pop();
+            node_ptr newtop = m_stack.back()->right;
+            m_stack.pop_back();
             m_vector.pop_back();
-            m_stack.push(newtop);
+            m_stack.push_back(newtop);
+        }
+    }
+
+    void previous()
+    {
+        if (!m_root)
+            throw std::runtime_error("Trying to decrement an MDD iterator that has no root.");
+        if (m_stack.empty())
+        {
+            last(m_root);
+            return;
+        }
+        while (!m_stack.empty())
+        {
+            node_ptr current = m_stack.back();
+            node_ptr p = m_stack.size() == 1 ? m_root : m_stack[m_stack.size() - 2]->down;
+            if (p != current)
+            {
+                while (p->right != current)
+                    p = p->right;
+                m_stack.back() = p;
+                m_vector.push_back(p->value);
+                last(p->down);
+                return;
+            }
+            // There is nothing before current in its sibling list, so the previous vector
+            // comes before its parent.
+            m_stack.pop_back();
+            if (!m_stack.empty())
+                m_vector.pop_back();
+        }
+    }
+
+    /*
+     * Moves to the last vector in the sibling list p.
+     */
+    void last(node_ptr p)
+    {
+        node_ptr tail = p;
+        while (!tail->sentinel())
+            tail = tail->right;
+        if (tail == m_factory->emptylist())
+        {
+            m_stack.push_back(tail);
+            return;
         }
+        if (p == tail)
+            return;
+        while (p->right != tail)
+            p = p->right;
+        m_stack.push_back(p);
+        m_vector.push_back(p->value);
+        last(p->down);
     }
 
-    std::stack<node_ptr> m_stack;
+    std::vector<node_ptr> m_stack;
     vector_type m_vector;
     factory_ptr m_factory;
+    node_ptr m_root;
 };
 
 } // namespace mdd
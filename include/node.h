@@ -3,13 +3,47 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include <stdexcept>
+#ifdef MDD_THREAD_SAFE
+#include <atomic>
+#endif
+
+#include "node_arena.h"
 
 namespace mdd
 {
 
+#ifdef MDD_COMPACT_NODES
+/**
+ * In compact mode, the reference count of a node is packed into 32 bits, and its children
+ * are stored as 32-bit indices into the slabs of the node arenas (see node_arena::index()).
+ * A node<int> then takes 16 instead of 32 bytes, at the cost of a table lookup whenever a
+ * child is followed. A single node can be referenced at most 2^31 - 1 times; taking more
+ * references throws std::overflow_error.
+ */
+typedef uint32_t refcount_type;
+#else
+typedef uintptr_t refcount_type;
+#endif
+
+#ifdef MDD_THREAD_SAFE
+/**
+ * In thread-safe mode, reference counts are updated atomically, so that MDDs that share
+ * nodes can be copied and released from different threads.
+ */
+typedef std::atomic<refcount_type> refcount_storage;
+#else
+typedef refcount_type refcount_storage;
+#endif
+
+#if defined(MDD_MARK_SWEEP) && defined(MDD_THREAD_SAFE)
+#error "MDD_MARK_SWEEP cannot be combined with MDD_THREAD_SAFE"
+#endif
+
 template <typename Value, typename Hash=std::hash<Value> >
 struct node
 {
+    typedef Value value_type;
     typedef node<Value> node_type;
     typedef const node_type* node_ptr;
 
@@ -23,11 +57,16 @@ struct node
 
     struct hash
     {
-        long operator()(const node_ptr& r) const
+        size_t operator()(const node_ptr& r) const
+        {
+            return operator()(r->value, r->right, r->down);
+        }
+
+        size_t operator()(const Value& value, node_ptr right, node_ptr down) const
         {
-            uintptr_t a = Hash()(r->value),
-                      b = (uintptr_t)r->right,
-                      c = (uintptr_t)r->down;
+            uintptr_t a = Hash()(value),
+                      b = (uintptr_t)right,
+                      c = (uintptr_t)down;
             a -= b; a -= c; a ^= (c>>13);
             b -= c; b -= a; b ^= (a<<8);
             c -= a; c -= b; c ^= (b>>13);
@@ -41,18 +80,100 @@ struct node
         }
     };
 
+    /**
+     * The highest bit of the reference count is set when a node has been put on the list
+     * of dead nodes of its arena. A node stays on that list until the next call to
+     * node_factory::clean(), even if it is used again in the meantime. A dead node keeps
+     * its references to its children until clean() frees it, so that the children of every
+     * node in the unique table exist, regardless of the order in which dead nodes are
+     * freed.
+     */
+    static const refcount_type dead_bit = refcount_type(1) << (sizeof(refcount_type) * 8 - 1);
+
+#ifdef MDD_COMPACT_NODES
+    /**
+     * @brief Reference to a child, stored as its index in the node arenas. It converts to
+     *        and from node_ptr, so that it can be used like a pointer.
+     */
+    class link
+    {
+    public:
+        link()
+        { }
+
+        explicit link(node_ptr node)
+            : m_index(node_arena<node_type>::index(node))
+        { }
+
+        operator node_ptr() const
+        {
+            return node_arena<node_type>::at(m_index);
+        }
+
+        node_ptr operator->() const
+        {
+            return node_arena<node_type>::at(m_index);
+        }
+
+        bool operator!() const
+        {
+            return !m_index;
+        }
+    private:
+        uint32_t m_index;
+    };
+#else
+    typedef node_ptr link;
+#endif
+
     inline
     bool sentinel() const
     {
         return !down;
     }
 
+    inline
+    refcount_type references() const
+    {
+        return usecount & ~dead_bit;
+    }
+
+    /**
+     * @brief Takes a reference to this node, and returns the reference count (including
+     *        the dead bit) from before. In compact mode, a count that would overflow into
+     *        the dead bit is not taken, and std::overflow_error is thrown instead.
+     */
+    inline
+    refcount_type acquire() const
+    {
+        refcount_type old = usecount++;
+#ifdef MDD_COMPACT_NODES
+        if (((old + 1) & ~dead_bit) == 0)
+        {
+            --usecount;
+            throw std::overflow_error("Too many references to a single MDD node.");
+        }
+#endif
+        assert(((old + 1) & ~dead_bit) != 0);
+        return old;
+    }
+
+    /*
+     * When compiled with MDD_MARK_SWEEP, nodes are not reference counted: use() and unuse()
+     * do nothing, and usecount is only used as a mark bit by the garbage collector of the
+     * node_factory.
+     *
+     * Otherwise, a node whose reference count drops to zero is retired to its arena, where
+     * node_factory::clean() will find it. Its children are released when it is freed.
+     */
+
     inline
     node_ptr use() const
     {
+#ifndef MDD_MARK_SWEEP
         if (!sentinel())
         {
-            ++usecount;
+            acquire();
 #ifdef DEBUG_MDD_NODES
             if (usecount == 1)
             {
@@ -68,19 +189,37 @@ struct node
             }
 #endif
         }
+#endif // MDD_MARK_SWEEP
         return this;
     }
 
+    /**
+     * @brief Takes a reference to this node, which may no longer be referenced. This is only
+     *        valid if the node has not been freed since it was last referenced.
+     */
+    inline
+    node_ptr revive() const
+    {
+        return use();
+    }
+
     inline
     void unuse() const
     {
+#ifndef MDD_MARK_SWEEP
         if (!sentinel())
         {
-            assert(usecount > 0);
-            if (--usecount == 0)
+            assert(references() > 0);
+            if ((--usecount & ~dead_bit) == 0)
             {
-                down->unuse();
-                right->unuse();
+#ifdef MDD_THREAD_SAFE
+                bool retire = !(usecount.fetch_or(dead_bit) & dead_bit);
+#else
+                bool retire = !(usecount & dead_bit);
+                usecount |= dead_bit;
+#endif
+                if (retire)
+                    node_arena<node>::retire(this);
             }
 #ifdef DEBUG_MDD_NODES
             std::cout << "Deleted " << this << "(" << value << ", "
@@ -88,19 +227,20 @@ struct node
                       << usecount << std::endl;
 #endif
         }
+#endif // MDD_MARK_SWEEP
     }
 
     Value value;
-    node_ptr right;
-    node_ptr down;
-    mutable uintptr_t usecount;
+    mutable refcount_storage usecount;
+    link right;
+    link down;
 
     node()
-        : down(nullptr)
+        : right(nullptr), down(nullptr)
     { }
 
-    node(const Value& value, node_ptr right, node_ptr down, uintptr_t usecount)
-        : value(value), right(right), down(down), usecount(usecount)
+    node(const Value& value, node_ptr right, node_ptr down, refcount_type usecount)
+        : value(value), usecount(usecount), right(right), down(down)
     {}
 };
 
@@ -0,0 +1,333 @@
+#ifndef __scranen_mdd_node_arena_h
+#define __scranen_mdd_node_arena_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+#include "utilities/mutex.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Slab allocator for MDD nodes.
+ *
+ * Nodes are carved out of large slabs owned by the arena. Destroyed nodes are put on an
+ * intrusive free list and are handed out again by subsequent allocations, so that node
+ * creation never has to go through the general purpose allocator. Slabs are only given
+ * back to the system when the arena itself is destroyed.
+ *
+ * Slabs are aligned to their size, and start with a pointer to the arena that owns them.
+ * This allows a node whose reference count drops to zero to put itself on the list of
+ * dead nodes of its arena (see retire()), without knowing where it was allocated.
+ *
+ * When compiled with MDD_COMPACT_NODES, every slab is also entered in a table that is
+ * shared by all arenas for Node. A node can then be identified by a 32-bit index: the
+ * position of its slab in that table, followed by the position of the node in its slab
+ * (see index() and at()).
+ */
+template <typename Node>
+class node_arena
+{
+public:
+    typedef size_t size_type;
+
+    /**
+     * @brief The size of a single slab in bytes. Must be a power of two.
+     */
+    static const size_type slab_bytes = size_type(1) << 17;
+
+    node_arena()
+        : m_free(nullptr), m_next(nullptr), m_end(nullptr), m_used(0)
+    { }
+
+    node_arena(const node_arena&) = delete;
+    node_arena& operator=(const node_arena&) = delete;
+
+    /**
+     * @brief Destructor. Releases all slabs; nodes that were not destroyed by then are
+     *        not destructed.
+     */
+    ~node_arena()
+    {
+        for (auto it = m_slabs.begin(); it != m_slabs.end(); ++it)
+            free_slab(*it);
+    }
+
+    /**
+     * @brief Constructs a new node in the arena.
+     * @param args The arguments to pass to the constructor of Node.
+     * @return A pointer to the newly constructed node.
+     */
+    template <typename... Args>
+    Node* create(Args&&... args)
+    {
+        block* b = m_free;
+        if (b)
+            m_free = b->next;
+        else
+        {
+            if (m_next == m_end)
+                grow();
+            b = m_next++;
+        }
+        ++m_used;
+        return new (&b->storage) Node(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Destructs \p node and puts its memory on the free list.
+     * @param node A node that was created by this arena.
+     */
+    void destroy(const Node* node)
+    {
+        Node* n = const_cast<Node*>(node);
+        n->~Node();
+        block* b = reinterpret_cast<block*>(n);
+        b->next = m_free;
+        m_free = b;
+        --m_used;
+    }
+
+    /**
+     * @brief Puts \p node on the list of dead nodes of the arena that allocated it.
+     * @param node A node that was created by a node_arena.
+     */
+    static void retire(const Node* node)
+    {
+        node_arena* arena = slab_of(node)->arena;
+        utilities::lock_guard lock(arena->m_mutex);
+        arena->m_dead.push_back(node);
+    }
+
+    /**
+     * @brief Takes a node from the list of dead nodes.
+     * @param node Set to the node that was taken from the list.
+     * @return False if the list was empty, true otherwise.
+     */
+    bool pop_retired(const Node*& node)
+    {
+        utilities::lock_guard lock(m_mutex);
+        if (m_dead.empty())
+            return false;
+        node = m_dead.back();
+        m_dead.pop_back();
+        return true;
+    }
+
+    /**
+     * @brief Forgets all nodes on the list of dead nodes.
+     */
+    void clear_retired()
+    {
+        utilities::lock_guard lock(m_mutex);
+        m_dead.clear();
+    }
+
+    /**
+     * @brief Returns the number of nodes on the list of dead nodes.
+     */
+    size_type retired() const
+    {
+        utilities::lock_guard lock(m_mutex);
+        return m_dead.size();
+    }
+
+    /**
+     * @brief Returns the node at position \p index of the list of dead nodes. Nodes are
+     *        added at the end of the list.
+     */
+    const Node* retired(size_type index) const
+    {
+        utilities::lock_guard lock(m_mutex);
+        return m_dead[index];
+    }
+
+#ifdef MDD_COMPACT_NODES
+    /**
+     * @brief Returns the index of \p node, which is zero for nullptr.
+     * @param node A node that was created by a node_arena, or nullptr.
+     */
+    static uint32_t index(const Node* node)
+    {
+        if (!node)
+            return 0;
+        header* h = slab_of(node);
+        return uint32_t(h->id << index_bits | (reinterpret_cast<const block*>(node) - reinterpret_cast<const block*>(h)));
+    }
+
+    /**
+     * @brief Returns the node with index \p index, or nullptr if \p index is zero.
+     */
+    static const Node* at(uint32_t index)
+    {
+        if (!index)
+            return nullptr;
+        const block* slab = reinterpret_cast<const block*>(slab_table()[index >> index_bits]);
+        return reinterpret_cast<const Node*>(slab + (index & ((uint32_t(1) << index_bits) - 1)));
+    }
+#endif
+
+    /**
+     * @brief Returns the number of nodes that are currently allocated.
+     */
+    size_type size() const
+    {
+        return m_used;
+    }
+
+    /**
+     * @brief Returns the number of bytes reserved by the arena.
+     */
+    size_type bytes() const
+    {
+        return m_slabs.size() * slab_bytes;
+    }
+private:
+    union block
+    {
+        block* next;
+        typename std::aligned_storage<sizeof(Node), std::alignment_of<Node>::value>::type storage;
+    };
+
+    struct header
+    {
+        node_arena* arena;
+        size_type id;
+    };
+
+    // The first block of a slab starts at the first multiple of sizeof(block) that lies
+    // beyond the header. No node is at position zero, so no node has index zero.
+    static const size_type first_block = (sizeof(header) + sizeof(block) - 1) / sizeof(block);
+    static const size_type slab_blocks = slab_bytes / sizeof(block);
+
+    static header* slab_of(const Node* node)
+    {
+        return reinterpret_cast<header*>((uintptr_t)node & ~(uintptr_t)(slab_bytes - 1));
+    }
+
+#ifdef MDD_COMPACT_NODES
+    static constexpr unsigned bits(size_type n)
+    {
+        return n <= 1 ? 0 : 1 + bits((n + 1) / 2);
+    }
+
+    static const unsigned index_bits = bits(slab_blocks);
+    static const size_type max_slabs = size_type(1) << (32 - index_bits);
+
+    /*
+     * The slabs of all arenas for Node, by id. An entry is written before any node in its
+     * slab is handed out, so nodes can be found without taking a lock.
+     */
+    static header** slab_table()
+    {
+        static header* table[max_slabs];
+        return table;
+    }
+
+    struct slab_ids
+    {
+        utilities::mutex mutex;
+        std::vector<size_type> free;
+        size_type next;
+
+        slab_ids()
+            : next(0)
+        { }
+    };
+
+    static slab_ids& ids()
+    {
+        static slab_ids instance;
+        return instance;
+    }
+
+    static void register_slab(header* slab)
+    {
+        slab_ids& ids = node_arena::ids();
+        utilities::lock_guard lock(ids.mutex);
+        if (!ids.free.empty())
+        {
+            slab->id = ids.free.back();
+            ids.free.pop_back();
+        }
+        else
+        if (ids.next < max_slabs)
+            slab->id = ids.next++;
+        else
+            throw std::bad_alloc();
+        slab_table()[slab->id] = slab;
+    }
+
+    static void unregister_slab(header* slab)
+    {
+        slab_ids& ids = node_arena::ids();
+        utilities::lock_guard lock(ids.mutex);
+        slab_table()[slab->id] = nullptr;
+        ids.free.push_back(slab->id);
+    }
+#endif
+
+    void grow()
+    {
+        void* slab;
+#ifdef _WIN32
+        slab = _aligned_malloc(slab_bytes, slab_bytes);
+        if (!slab)
+            throw std::bad_alloc();
+#else
+        if (posix_memalign(&slab, slab_bytes, slab_bytes) != 0)
+            throw std::bad_alloc();
+#endif
+        header* h = static_cast<header*>(slab);
+        h->arena = this;
+        h->id = 0;
+        try
+        {
+#ifdef MDD_COMPACT_NODES
+            register_slab(h);
+#endif
+            m_slabs.push_back(h);
+        }
+        catch (...)
+        {
+            free_slab(h);
+            throw;
+        }
+        m_next = reinterpret_cast<block*>(slab) + first_block;
+        m_end = reinterpret_cast<block*>(slab) + slab_blocks;
+    }
+
+    static void free_slab(header* slab)
+    {
+#ifdef MDD_COMPACT_NODES
+        if (slab_table()[slab->id] == slab)
+            unregister_slab(slab);
+#endif
+#ifdef _WIN32
+        _aligned_free(slab);
+#else
+        free(slab);
+#endif
+    }
+
+    std::vector<header*> m_slabs;
+    block* m_free;
+    block* m_next;
+    block* m_end;
+    size_type m_used;
+    std::vector<const Node*> m_dead;
+    mutable utilities::mutex m_mutex;
+};
+
+} // namespace mdd
+
+#endif // __scranen_mdd_node_arena_h
@@ -2,9 +2,15 @@
 #define __scranen_mdd_node_cache_h
 
 #include "node.h"
+#include "utilities/mutex.h"
 
-#include <unordered_map>
-#include <tuple>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <functional>
+#include <utility>
+#include <vector>
 
 namespace mdd
 {
@@ -20,7 +26,11 @@ enum cache_operation
     cache_rel_next             = 6,
     cache_rel_prev             = 7,
     cache_set_project          = 8,
-    cache_clear                = 16 // <-- used as bit mask, must be next power of 2
+    cache_rel_saturate         = 9,
+    cache_rel_next_union       = 10,
+    cache_rel_next_minus       = 11,
+    cache_rel_next_multi       = 12,
+    cache_operation_count      = 13 // <-- must be last
 };
 
 template <class T>
@@ -29,99 +39,173 @@ inline void hash_combine(size_t& seed, T const& v)
     seed ^= std::hash<T>()(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
 }
 
+/**
+ * @brief Returns a counter that is incremented whenever a node factory is destroyed. Every
+ *        factory also counts the times it freed nodes itself (see node_factory::generation()).
+ *        Caches watch both counters: the one of their own factory, and this one, because
+ *        cache keys may also contain projection nodes, which belong to a different factory.
+ *        Projection nodes are only freed when their factory is destroyed.
+ */
+inline
+std::atomic<size_t>& node_generation()
+{
+    static std::atomic<size_t> generation(0);
+    return generation;
+}
+
+/**
+ * @brief Configuration of the operation cache of a factory.
+ */
+struct cache_config
+{
+    /**
+     * @brief The initial number of entries of the partition of each operation. A size of
+     *        zero disables caching for that operation.
+     */
+    size_t size[cache_operation_count];
+
+    /**
+     * @brief The minimum amount of work for a result to be stored, per operation. The work
+     *        of a result is the number of cache misses that occurred while computing it,
+     *        including the miss for the result itself.
+     */
+    size_t work_threshold[cache_operation_count];
+
+    /**
+     * @brief If true, partitions grow when many of their entries are evicted while they
+     *        have a reasonable hit rate, and shrink when they hardly have any hits.
+     */
+    bool adaptive;
+
+    /**
+     * @brief The bounds between which adaptive partitions are resized.
+     */
+    size_t min_size;
+    size_t max_size;
+
+    /**
+     * @brief The number of entries of the victim cache, which is shared by all operations.
+     *        Entries that are evicted from a partition move to the victim cache if they
+     *        took more work than the cheapest entry they would replace there. A size of
+     *        zero disables the victim cache.
+     */
+    size_t victim_size;
+
+    cache_config()
+        : adaptive(true), min_size(size_t(1) << 10), max_size(size_t(1) << 20),
+          victim_size(size_t(1) << 14)
+    {
+        for (int op = 0; op < cache_operation_count; ++op)
+        {
+            size[op] = size_t(1) << 15;
+            work_threshold[op] = 0;
+        }
+    }
+};
+
+/**
+ * @brief Operation cache.
+ *
+ * The cache is split into one partition per operation, so that the results of different
+ * operations do not evict each other. Each partition is a 2-way set associative table of
+ * flat entries. It is lossy: storing a result evicts the least recently used entry of its
+ * set. Entries do not hold references to the nodes they mention. Instead, every entry
+ * carries the epoch in which it was stored. The epoch changes when the cache is cleared,
+ * when the factory of the cache frees nodes and when any factory is destroyed, which
+ * invalidates all entries at once. As long as an entry
+ * is valid, all nodes it mentions still exist, so a result that is no longer referenced can
+ * be revived.
+ *
+ * Results that are evicted from a partition get a second chance in a 4-way set associative
+ * victim cache, in which entries are weighted by the work it took to compute them. Within
+ * a set of the victim cache, the entry with the lowest weight is replaced first, and all
+ * weights are halved periodically so that old expensive results eventually make way for
+ * new ones. This keeps results of expensive operations such as rel_next around when they
+ * are flooded by cheap set operations.
+ *
+ * Partitions are only allocated when their first result is stored. See cache_config for
+ * the sizing policies.
+ *
+ * When compiled with MDD_THREAD_SAFE, the sets are guarded by a number of locks, selected
+ * by the index of the set, so that threads only wait for each other when they use sets
+ * that share a lock. Counters are atomic. Allocating or resizing a partition takes all
+ * locks.
+ */
 template <typename Node>
-struct cacherecord : public std::tuple<uintptr_t, const Node*, const Node*, const node<size_t>*>
+class node_cache
 {
-    typedef std::tuple<uintptr_t, const Node*, const Node*, const node<size_t>*> parent;
+public:
+    typedef size_t size_type;
     typedef const Node* node_ptr;
     typedef const node<size_t>* proj_ptr;
-    typedef cacherecord<Node> record_type;
+    typedef uint64_t key_type;
 
-    void make_clear_operation()
+    /**
+     * @brief Constructor.
+     * @param config The sizing policies of the cache.
+     * @param generation The counter of the factory whose nodes are cached, which is
+     *        incremented whenever that factory frees nodes.
+     */
+    node_cache(const cache_config& config = cache_config(), const std::atomic<size_t>* generation = nullptr)
+        : m_config(config), m_victims(nullptr), m_victim_sets(config.victim_size / victim_ways),
+          m_victim_stores(0), m_victim_hits(0), m_epoch(1), m_factory_generation(generation),
+          m_generation(current_generation())
     {
-        std::get<0>(*this) |= cache_clear;
+        for (int op = 0; op < cache_operation_count; ++op)
+            m_partitions[op].reset(config.size[op]);
+        while (m_victim_sets & (m_victim_sets - 1))
+            m_victim_sets &= m_victim_sets - 1;
     }
 
-    void make_insert_operation()
+    node_cache(const node_cache&) = delete;
+    node_cache& operator=(const node_cache&) = delete;
+
+    /**
+     * @brief Scope guard for the results that the calling thread starts to compute. Results
+     *        that were looked up in the scope but not stored when it ends, because their
+     *        computation returned early or threw, are forgotten, so that their work is not
+     *        charged to results that are stored later.
+     */
+    class scope
     {
-        std::get<0>(*this) &= ~cache_clear;
-    }
+    public:
+        scope()
+            : m_depth(work_stack().size())
+        { }
 
-    struct hash{
-        unsigned int operator()(const record_type& r) const
+        ~scope()
         {
-            size_t result = 0;
-            hash_combine(result, std::get<0>(r) & ~cache_clear);
-            hash_combine(result, std::get<1>(r));
-            hash_combine(result, std::get<2>(r));
-            hash_combine(result, std::get<3>(r));
-            return result;
+            std::vector<frame>& stack = work_stack();
+            if (stack.size() > m_depth)
+                stack.erase(stack.begin() + m_depth, stack.end());
         }
-    };
 
-    struct equal
-    {
-        bool operator()(const record_type& a, const record_type& b) const
-        {
-            return (a == b) || (std::get<0>(a) & cache_clear)  || (std::get<0>(b) & cache_clear);
-        }
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    private:
+        size_type m_depth;
     };
 
-    cacherecord(cache_operation op, node_ptr arg1, node_ptr arg2, proj_ptr arg3)
-        :  parent(op, arg1, arg2, arg3)
+    /**
+     * @brief Returns the number of results that the calling thread is computing, that is,
+     *        that were looked up in a cache for Node and are not stored yet.
+     */
+    static size_type computing()
     {
-        std::get<1>(*this)->use();
-        if (std::get<2>(*this))
-            std::get<2>(*this)->use();
-        if (std::get<3>(*this))
-            std::get<3>(*this)->use();
+        return work_stack().size();
     }
 
-    cacherecord(const cacherecord& other)
-        : parent(other)
+    ~node_cache()
     {
-        std::get<1>(*this)->use();
-        if (std::get<2>(*this))
-            std::get<2>(*this)->use();
-        if (std::get<3>(*this))
-            std::get<3>(*this)->use();
+        delete[] m_victims.load();
     }
 
-    ~cacherecord()
-    {
-        std::get<1>(*this)->unuse();
-        if (std::get<2>(*this))
-            std::get<2>(*this)->unuse();
-        if (std::get<3>(*this))
-            std::get<3>(*this)->unuse();
-    }
-};
-
-template <typename Node>
-class node_cache : private std::unordered_map<cacherecord<Node>,
-                                             const Node*,
-                                             typename cacherecord<Node>::hash,
-                                             typename cacherecord<Node>::equal>
-{
-public:
-    typedef std::unordered_map<cacherecord<Node>, const Node*, typename cacherecord<Node>::hash, typename cacherecord<Node>::equal> parent;
-    typedef typename parent::size_type size_type;
-    typedef cacherecord<Node> cacherecord_type;
-    typedef const Node* node_ptr;
-    typedef const node<size_t>* proj_ptr;
-
-    node_cache(size_type size=100000)
-        : parent(size), m_hits(0), m_misses(0), m_stores(0)
-    { }
-
+    /**
+     * @brief Invalidates all entries.
+     */
     void clear()
     {
-        auto it = parent::begin();
-        while (it != parent::end())
-        {
-            it->second->unuse();
-            it = parent::erase(it);
-        }
+        ++m_epoch;
     }
 
     inline
@@ -133,15 +217,67 @@ public:
     inline
     bool lookup(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr& result)
     {
-        cacherecord_type rec(op, a, b, c);
-        auto it = parent::find(rec);
-        if (it != parent::end())
+        return lookup(op, a, b, c, nullptr, result);
+    }
+
+    inline
+    bool lookup(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d, node_ptr& result)
+    {
+        return lookup(op, a, b, c, d, 0, result);
+    }
+
+    /**
+     * @brief Looks up the result of \p op on \p a, \p b, \p c, \p d and \p k. After a miss,
+     *        the caller must compute the result and pass it to store().
+     * @param k An operand that is not a node, such as the level at which an operation is
+     *        applied.
+     * @param result Set to the cached result, which is then owned by the caller.
+     * @return True if the result was found, false otherwise.
+     */
+    inline
+    bool lookup(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d, key_type k, node_ptr& result)
+    {
+        if (bypassed(op))
+            return false;
+        partition& p = m_partitions[op];
+        size_t h = hash(op, a, b, c, d, k);
+        synchronize();
+        size_t epoch = m_epoch;
+        {
+            set_lock lock(*this, p, h);
+            if (p.entries)
+            {
+                entry* set = p.entries + 2 * (h & (p.sets - 1));
+                for (int way = 0; way < 2; ++way)
+                {
+                    if (!set[way].matches(epoch, op, a, b, c, d, k))
+                        continue;
+                    result = set[way].result->revive();
+                    if (way)
+                        std::swap(set[0], set[1]);
+                    ++p.hits;
+                    ++p.window_hits;
+                    return true;
+                }
+            }
+        }
+        if (entry* victims = m_victims.load(std::memory_order_acquire))
         {
-            ++m_hits;
-            result = it->second;
-            return true;
+            size_type index = victim_index(h);
+            utilities::lock_guard lock(m_victim_stripes[index & (stripe_count - 1)]);
+            entry* set = victims + victim_ways * index;
+            for (int way = 0; way < victim_ways; ++way)
+            {
+                if (!set[way].matches(epoch, op, a, b, c, d, k))
+                    continue;
+                result = set[way].result->revive();
+                ++p.hits;
+                ++m_victim_hits;
+                return true;
+            }
         }
-        ++m_misses;
+        ++p.misses;
+        work_stack().push_back(frame(this, op, a, b, c, d, k, ++work()));
         return false;
     }
 
@@ -154,34 +290,467 @@ public:
     inline
     void store(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr result)
     {
-        cacherecord_type rec(op, a, b, c);
-        // First, clear the bucket
-        rec.make_clear_operation();
-        parent::erase(rec);
-        rec.make_insert_operation();
-        // Then insert.
-        parent::insert(std::move(std::make_pair(std::move(rec), std::move(result->use()))));
-        ++m_stores;
+        store(op, a, b, c, nullptr, result);
+    }
+
+    inline
+    void store(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d, node_ptr result)
+    {
+        store(op, a, b, c, d, 0, result);
+    }
+
+    /**
+     * @brief Stores \p result as the result of \p op on \p a, \p b, \p c, \p d and \p k.
+     *        Ownership of \p result stays with the caller.
+     */
+    inline
+    void store(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d, key_type k, node_ptr result)
+    {
+        if (bypassed(op))
+            return;
+        size_type start = pop_frame(op, a, b, c, d, k);
+        partition& p = m_partitions[op];
+        size_type work = this->work() - start + 1;
+        if (work < m_config.work_threshold[op])
+            return;
+        size_t h = hash(op, a, b, c, d, k);
+        synchronize();
+        entry e;
+        e.op = op;
+        e.work = (unsigned int)std::min<size_type>(work, std::numeric_limits<unsigned int>::max());
+        e.a = a;
+        e.b = b;
+        e.c = c;
+        e.d = d;
+        e.k = k;
+        e.result = result;
+        e.epoch = m_epoch;
+        bool stored = false, full = false;
+        {
+            set_lock lock(*this, p, h);
+            if (p.entries)
+            {
+                full = put(p, h, e);
+                stored = true;
+            }
+        }
+        if (!stored)
+        {
+            exclusive_lock lock(m_stripes);
+            if (!p.entries)
+                p.entries = new entry[2 * p.sets]();
+            full = put(p, h, e);
+        }
+        if (full)
+        {
+            exclusive_lock lock(m_stripes);
+            if (p.window_stores >= 2 * p.sets)
+                adapt(p);
+        }
     }
 
     size_type hits() const
     {
-        return m_hits;
+        size_type result = 0;
+        for (int op = 0; op < cache_operation_count; ++op)
+            result += m_partitions[op].hits;
+        return result;
     }
 
     size_type misses() const
     {
-        return m_misses;
+        size_type result = 0;
+        for (int op = 0; op < cache_operation_count; ++op)
+            result += m_partitions[op].misses;
+        return result;
     }
 
     size_type stores() const
     {
-        return m_stores;
+        size_type result = 0;
+        for (int op = 0; op < cache_operation_count; ++op)
+            result += m_partitions[op].stores;
+        return result;
+    }
+
+    size_type hits(cache_operation op) const
+    {
+        return m_partitions[op].hits;
+    }
+
+    size_type misses(cache_operation op) const
+    {
+        return m_partitions[op].misses;
+    }
+
+    size_type stores(cache_operation op) const
+    {
+        return m_partitions[op].stores;
+    }
+
+    /**
+     * @brief Returns the number of hits that were found in the victim cache.
+     */
+    size_type victim_hits() const
+    {
+        return m_victim_hits;
+    }
+
+    /**
+     * @brief Returns the current number of entries of the partition of \p op.
+     */
+    size_type capacity(cache_operation op) const
+    {
+        return 2 * m_partitions[op].sets;
     }
 private:
-    size_type m_hits;
-    size_type m_misses;
-    size_type m_stores;
+#ifdef MDD_THREAD_SAFE
+    typedef std::atomic<size_type> counter;
+    static const unsigned stripe_bits = 5;
+#else
+    typedef size_type counter;
+    static const unsigned stripe_bits = 0;
+#endif
+    static const size_type stripe_count = size_type(1) << stripe_bits;
+
+    struct entry
+    {
+        node_ptr a;
+        node_ptr b;
+        proj_ptr c;
+        node_ptr d;
+        key_type k;
+        node_ptr result;
+        size_t epoch;
+        unsigned int op;
+        unsigned int work;
+
+        bool matches(size_t epoch, cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d,
+                     key_type k) const
+        {
+            return this->epoch == epoch && this->a == a && this->b == b && this->c == c && this->d == d &&
+                   this->k == k && this->op == (unsigned int)op;
+        }
+    };
+
+    struct partition
+    {
+        entry* entries;
+        counter sets;
+        counter hits;
+        counter misses;
+        counter stores;
+        counter window_hits;
+        counter window_stores;
+        counter window_evictions;
+        bool warm;
+
+        partition()
+            : entries(nullptr), sets(0), hits(0), misses(0), stores(0)
+        { }
+
+        ~partition()
+        {
+            delete[] entries;
+        }
+
+        void reset(size_type size)
+        {
+            delete[] entries;
+            entries = nullptr;
+            size_type count = 0;
+            if (size >= 2)
+            {
+                count = 1;
+                while (count * 4 <= size)
+                    count *= 2;
+            }
+            sets = count;
+            window_hits = 0;
+            window_stores = 0;
+            window_evictions = 0;
+            warm = false;
+        }
+    };
+
+    /*
+     * Locks the stripe of the set of a hash in a partition. The number of sets can only
+     * change while all stripes are locked, so it is read again once the stripe is held.
+     */
+    class set_lock
+    {
+    public:
+        set_lock(node_cache& cache, const partition& p, size_t hash)
+        {
+            for (;;)
+            {
+                size_type sets = p.sets;
+                m_mutex = &cache.m_stripes[hash & (sets - 1) & (stripe_count - 1)];
+                m_mutex->lock();
+                if (sets == p.sets)
+                    break;
+                m_mutex->unlock();
+            }
+        }
+
+        ~set_lock()
+        {
+            m_mutex->unlock();
+        }
+
+        set_lock(const set_lock&) = delete;
+        set_lock& operator=(const set_lock&) = delete;
+    private:
+        utilities::mutex* m_mutex;
+    };
+
+    /*
+     * Locks all stripes of an array, in order.
+     */
+    class exclusive_lock
+    {
+    public:
+        exclusive_lock(utilities::mutex (&stripes)[stripe_count])
+            : m_stripes(stripes)
+        {
+            for (size_type i = 0; i < stripe_count; ++i)
+                m_stripes[i].lock();
+        }
+
+        ~exclusive_lock()
+        {
+            for (size_type i = stripe_count; i-- > 0;)
+                m_stripes[i].unlock();
+        }
+
+        exclusive_lock(const exclusive_lock&) = delete;
+        exclusive_lock& operator=(const exclusive_lock&) = delete;
+    private:
+        utilities::mutex (&m_stripes)[stripe_count];
+    };
+
+    /*
+     * Results that are being computed. Frames are pushed on a miss and popped by the
+     * corresponding store, so the difference in work() between the two is the work that
+     * was needed to compute the result. Frames of results that are never stored are
+     * removed by the scope in which they were pushed.
+     */
+    struct frame
+    {
+        const node_cache* cache;
+        cache_operation op;
+        node_ptr a;
+        node_ptr b;
+        proj_ptr c;
+        node_ptr d;
+        key_type k;
+        size_type start;
+
+        frame(const node_cache* cache, cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d,
+              key_type k, size_type start)
+            : cache(cache), op(op), a(a), b(b), c(c), d(d), k(k), start(start)
+        { }
+    };
+
+    static std::vector<frame>& work_stack()
+    {
+        static thread_local std::vector<frame> stack;
+        return stack;
+    }
+
+    static size_type& work()
+    {
+        static thread_local size_type counter = 0;
+        return counter;
+    }
+
+    size_type pop_frame(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d, key_type k)
+    {
+        // Frames above the matching one belong to results that were never stored. A store
+        // without a frame leaves the stack alone, so that it does not take the frames of
+        // the results that are still being computed.
+        std::vector<frame>& stack = work_stack();
+        for (size_type i = stack.size(); i-- > 0;)
+        {
+            const frame& f = stack[i];
+            if (f.cache == this && f.op == op && f.a == a && f.b == b && f.c == c && f.d == d && f.k == k)
+            {
+                size_type start = f.start;
+                stack.erase(stack.begin() + i, stack.end());
+                return start;
+            }
+        }
+        return work() + 1;
+    }
+
+    /*
+     * Stores e in the set of hash h of p, which must be locked. Returns true if p should be
+     * adapted.
+     */
+    bool put(partition& p, size_t h, const entry& e)
+    {
+        entry* set = p.entries + 2 * (h & (p.sets - 1));
+        if (!set[0].matches(e.epoch, (cache_operation)e.op, e.a, e.b, e.c, e.d, e.k))
+        {
+            if (set[1].epoch == e.epoch)
+            {
+                ++p.window_evictions;
+                evict(set[1]);
+            }
+            set[1] = set[0];
+        }
+        set[0] = e;
+        ++p.stores;
+        return m_config.adaptive && ++p.window_stores >= 2 * p.sets;
+    }
+
+    void adapt(partition& p)
+    {
+        // Grow if more than half of the stores evicted a valid entry while at least one in
+        // ten lookups hit; shrink if fewer than one in a hundred lookups hit. The first
+        // window after a resize is ignored, as the entries that did not fit are lost.
+        size_type lookups = p.window_stores + p.window_hits;
+        size_type size = 2 * p.sets;
+        if (!p.warm)
+            p.warm = true;
+        else
+        if (p.window_evictions * 2 > p.window_stores && p.window_hits * 10 >= lookups)
+            size *= 2;
+        else
+        if (p.window_hits * 100 < lookups)
+            size /= 2;
+        if (size > m_config.max_size || size < std::max<size_type>(m_config.min_size, 2) || size == 2 * p.sets)
+        {
+            p.window_hits = p.window_stores = p.window_evictions = 0;
+            return;
+        }
+        entry* entries = p.entries;
+        size_type sets = p.sets;
+        p.entries = nullptr;
+        p.reset(size);
+        p.entries = new entry[2 * p.sets]();
+        // Valid entries are moved to the new table, most recently used ones first.
+        for (int way = 0; way < 2; ++way)
+        {
+            for (size_type i = 0; i < sets; ++i)
+            {
+                const entry& e = entries[2 * i + way];
+                if (e.epoch != m_epoch)
+                    continue;
+                entry* set = p.entries + 2 * (hash((cache_operation)e.op, e.a, e.b, e.c, e.d, e.k) & (p.sets - 1));
+                if (set[0].epoch != m_epoch)
+                    set[0] = e;
+                else
+                if (set[1].epoch != m_epoch)
+                    set[1] = e;
+            }
+        }
+        delete[] entries;
+    }
+
+    /*
+     * Operations whose partition has no entries skip the cache entirely: they are not
+     * counted, and do not take part in measuring work.
+     */
+    bool bypassed(cache_operation op) const
+    {
+        return m_config.size[op] < 2;
+    }
+
+    static const int victim_ways = 4;
+
+    void evict(const entry& e)
+    {
+        if (m_victim_sets == 0 || e.work <= 1)
+            return;
+        entry* victims = m_victims.load(std::memory_order_acquire);
+        if (!victims)
+        {
+            entry* fresh = new entry[victim_ways * m_victim_sets]();
+            if (m_victims.compare_exchange_strong(victims, fresh))
+                victims = fresh;
+            else
+                delete[] fresh;
+        }
+        {
+            size_type index = victim_index(hash((cache_operation)e.op, e.a, e.b, e.c, e.d, e.k));
+            utilities::lock_guard lock(m_victim_stripes[index & (stripe_count - 1)]);
+            entry* set = victims + victim_ways * index;
+            entry* cheapest = set;
+            for (int way = 0; way < victim_ways; ++way)
+            {
+                if (set[way].epoch != e.epoch)
+                {
+                    cheapest = set + way;
+                    break;
+                }
+                if (set[way].work < cheapest->work)
+                    cheapest = set + way;
+            }
+            if (cheapest->epoch == e.epoch && cheapest->work >= e.work)
+                return;
+            *cheapest = e;
+        }
+        if (++m_victim_stores >= victim_ways * m_victim_sets)
+        {
+            exclusive_lock lock(m_victim_stripes);
+            if (m_victim_stores < victim_ways * m_victim_sets)
+                return;
+            m_victim_stores = 0;
+            for (size_type i = 0; i < victim_ways * m_victim_sets; ++i)
+                victims[i].work /= 2;
+        }
+    }
+
+    size_type victim_index(size_t hash) const
+    {
+        // Use different bits than the partitions, so that entries that collide there are
+        // spread over the victim cache.
+        return (hash >> 16 ^ hash) & (m_victim_sets - 1);
+    }
+
+    static size_t hash(cache_operation op, node_ptr a, node_ptr b, proj_ptr c, node_ptr d, key_type k)
+    {
+        size_t result = 0;
+        hash_combine(result, (unsigned int)op);
+        hash_combine(result, a);
+        hash_combine(result, b);
+        hash_combine(result, c);
+        hash_combine(result, d);
+        hash_combine(result, k);
+        return result;
+    }
+
+    // Both counters only grow, so their sum changes whenever one of them does.
+    size_t current_generation() const
+    {
+        size_t generation = node_generation().load(std::memory_order_relaxed);
+        if (m_factory_generation)
+            generation += m_factory_generation->load(std::memory_order_relaxed);
+        return generation;
+    }
+
+    void synchronize()
+    {
+        size_t generation = current_generation();
+        if (generation != m_generation)
+        {
+            m_generation = generation;
+            ++m_epoch;
+        }
+    }
+
+    cache_config m_config;
+    partition m_partitions[cache_operation_count];
+    std::atomic<entry*> m_victims;
+    size_type m_victim_sets;
+    counter m_victim_stores;
+    counter m_victim_hits;
+    counter m_epoch;
+    const std::atomic<size_t>* m_factory_generation;
+    counter m_generation;
+    utilities::mutex m_stripes[stripe_count];
+    utilities::mutex m_victim_stripes[stripe_count];
 };
 
 } // namespace mdd
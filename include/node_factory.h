@@ -1,11 +1,20 @@
 #ifndef __scranen_mdd_factory_h
 #define __scranen_mdd_factory_h
 
-#include <unordered_set>
+#include <algorithm>
+#include <atomic>
 #include <unordered_map>
+#include <vector>
+#include <limits>
+#include <functional>
+#include <stdexcept>
+#include <string>
 
 #include "node.h"
+#include "node_arena.h"
 #include "node_cache.h"
+#include "unique_table.h"
+#include "utilities/mutex.h"
 
 #ifdef DEBUG_MDD_NODES
 #include <iostream>
@@ -18,6 +27,52 @@ namespace mdd
 template <typename Value>
 class mdd_iterator;
 
+/**
+ * @brief Exact number of vectors in an MDD. This is a 128-bit integer where the compiler
+ *        supports it. Counts that do not fit saturate at the largest value.
+ */
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 path_count;
+#else
+typedef unsigned long long path_count;
+#endif
+
+/**
+ * @brief Thrown when a node_factory would have to grow beyond its byte budget.
+ */
+class budget_exceeded : public std::runtime_error
+{
+public:
+    budget_exceeded(size_t required, size_t budget)
+        : std::runtime_error("MDD node storage would grow to " + std::to_string(required) +
+                             " bytes, exceeding the budget of " + std::to_string(budget) + " bytes."),
+          required(required), budget(budget)
+    { }
+
+    size_t required;
+    size_t budget;
+};
+
+/**
+ * @brief Storage for the nodes of MDDs over values of type Value.
+ *
+ * When compiled with MDD_THREAD_SAFE, node creation, reference counting and the operation
+ * cache are synchronised, so that several threads can apply MDD operations to MDDs that
+ * come from the same factory at the same time. The unique table is then split into shards,
+ * each with its own arena and lock, so that threads only wait for each other when they
+ * create nodes that hash to the same shard. Garbage collection (clean()) still needs
+ * exclusive access to the factory.
+ *
+ * When compiled with MDD_MARK_SWEEP, nodes are not reference counted. Instead, every MDD
+ * handle registers itself as a root with its factory, and clean() marks all nodes that
+ * are reachable from a root and frees the others. Besides explicit calls to clean(), a
+ * collection is started at the next safe point once the number of nodes has reached
+ * the threshold set by gc_threshold(). Safe points are the moments at which an MDD handle
+ * receives the result of an operation that was not nested in another operation.
+ *
+ * The memory_policy of a factory lets it clear its cache and collect garbage by itself at
+ * safe points, and puts an upper bound on the memory used for nodes.
+ */
 template <typename Value>
 class node_factory
 {
@@ -25,39 +80,251 @@ public:
     friend class mdd_iterator<Value>;
 
     struct mdd_add_element;
+    struct mdd_remove_element;
+    struct mdd_remove_sorted;
     struct mdd_set_count;
+    struct mdd_set_rank;
+    struct mdd_set_sample;
     struct mdd_set_dot;
+    struct mdd_set_export;
+    struct mdd_set_for_each;
     struct mdd_set_project;
     struct mdd_set_union;
     struct mdd_set_minus;
     struct mdd_set_intersect;
     struct mdd_set_contains;
     struct mdd_set_match_proj;
+    struct mdd_set_from_sorted;
     struct mdd_rel_composition;
+    struct mdd_rel_for_each;
     struct mdd_rel_relabel;
     struct mdd_rel_next;
+    struct mdd_rel_next_union;
+    struct mdd_rel_next_minus;
     struct mdd_rel_prev;
+    struct mdd_rel_saturate;
+    struct mdd_rel_next_multi;
 
     typedef Value value_type;
     typedef const value_type& const_reference;
     typedef node<value_type> node_type;
     typedef const node_type* node_ptr;
-    typedef cacherecord<node_type> cacherecord_type;
     typedef node_cache<node_type> cache_type;
-    typedef typename std::unordered_set<node_ptr, typename node_type::hash, typename node_type::equal> hashtable;
+    typedef unique_table<node_type> hashtable;
     typedef typename hashtable::size_type size_type;
+
+    /**
+     * @brief Policies for automatic memory management. A value of zero disables the
+     *        corresponding policy; all policies are disabled by default.
+     */
+    struct memory_policy
+    {
+        /**
+         * @brief At a safe point, clean() is called if the number of unused nodes exceeds
+         *        this fraction of the number of nodes. Ignored when compiled with
+         *        MDD_MARK_SWEEP (see gc_threshold()). Not supported when compiled with
+         *        MDD_THREAD_SAFE, where clean() needs exclusive access that a safe point
+         *        cannot guarantee: a factory then rejects a policy that sets it, and
+         *        clean() has to be called explicitly.
+         */
+        double dead_ratio;
+
+        /**
+         * @brief At a safe point, the cache is cleared if the number of nodes has grown by
+         *        more than this amount since the cache was last cleared by this policy.
+         */
+        size_type cache_node_limit;
+
+        /**
+         * @brief The maximum number of bytes used by the node storage (see bytes()). The
+         *        budget is checked when an operation starts, so that an exception never
+         *        leaves an operation half done. An operation may grow the storage beyond
+         *        the budget while it runs; the next operation then fails.
+         */
+        size_type byte_budget;
+
+        /**
+         * @brief Called with the number of bytes used by the storage when an operation
+         *        starts while it exceeds byte_budget. If the callback returns, the operation
+         *        is carried out anyway. If no callback is set, a budget_exceeded exception
+         *        is thrown instead. The callback must not start operations on the factory,
+         *        but may release MDDs or call clean().
+         */
+        std::function<void(size_type)> budget_callback;
+
+        memory_policy()
+            : dead_ratio(0), cache_node_limit(0), byte_budget(0)
+        { }
+    };
+
+    /**
+     * @brief Garbage collection root. When compiled with MDD_MARK_SWEEP, every object that
+     *        holds on to a node of this factory outside of an operation must derive from
+     *        root (or contain one) for as long as it holds the node. Otherwise, this class
+     *        is empty.
+     */
+    class root
+    {
+#ifdef MDD_MARK_SWEEP
+        friend class node_factory;
+        root* m_prev;
+        root* m_next;
+        const node_ptr* m_node;
+
+        root()
+            : m_prev(this), m_next(this), m_node(nullptr)
+        { }
+    public:
+        root(node_factory& factory, const node_ptr* node)
+            : m_prev(&factory.m_roots), m_next(factory.m_roots.m_next), m_node(node)
+        {
+            m_next->m_prev = this;
+            m_prev->m_next = this;
+        }
+
+        ~root()
+        {
+            m_next->m_prev = m_prev;
+            m_prev->m_next = m_next;
+        }
+#else
+    public:
+        root(node_factory&, const node_ptr*)
+        { }
+#endif
+        root(const root&) = delete;
+        root& operator=(const root&) = delete;
+    };
+
+    /**
+     * @brief Scope guard that marks the execution of an operation. The byte budget is
+     *        checked when the guard is created, before the operation holds any nodes.
+     *        Safe points that are reached during an operation are ignored, except when
+     *        compiled with MDD_THREAD_SAFE. Cache misses of the operation that were not
+     *        stored when it ends are forgotten (see node_cache::scope).
+     * @throw budget_exceeded if the storage exceeds the byte budget of the memory_policy
+     *        and no callback is set.
+     */
+    class operation
+    {
+        typename cache_type::scope m_scope;
+#ifndef MDD_THREAD_SAFE
+        node_factory& m_factory;
+    public:
+        operation(node_factory& factory)
+            : m_factory(factory)
+        {
+            m_factory.check_budget();
+            ++m_factory.m_depth;
+        }
+
+        ~operation()
+        {
+            --m_factory.m_depth;
+        }
+#else
+    public:
+        operation(node_factory& factory)
+        {
+            factory.check_budget();
+        }
+#endif
+        operation(const operation&) = delete;
+        operation& operator=(const operation&) = delete;
+    };
 private:
-    hashtable m_nodes;
+    /*
+     * A part of the unique table. A node is stored in the shard that is selected by the
+     * highest bits of its hash, and allocated from the arena of that shard.
+     */
+    struct shard
+    {
+        node_arena<node_type> arena;
+        hashtable nodes;
+        mutable utilities::mutex mutex;
+    };
+#ifdef MDD_THREAD_SAFE
+    static const unsigned shard_bits = 6;
+#else
+    static const unsigned shard_bits = 0;
+#endif
+    static const size_type shard_count = size_type(1) << shard_bits;
+
+    shard m_shards[shard_count];
+    std::atomic<size_t> m_generation;
     cache_type m_cache;
-    node_type m_sentinels[2];
+    node_ptr m_sentinels[2];
+    memory_policy m_policy;
+    size_type m_cache_limit;
+#ifndef MDD_THREAD_SAFE
+    size_type m_depth;
+#endif
+#if !defined(MDD_THREAD_SAFE) && !defined(MDD_MARK_SWEEP)
+    size_type m_unused;
+    size_type m_unused_scanned[shard_count];
+    std::unordered_map<node_ptr, refcount_type> m_unused_refs;
+#endif
+#ifdef MDD_MARK_SWEEP
+    root m_roots;
+    size_type m_gc_threshold;
+#endif
+    /*
+     * Memoized exact counts (see mdd_set_count). Nodes are spread over shards with their
+     * own lock, so that threads counting different MDDs rarely wait for each other. A shard
+     * is emptied when it would grow beyond count_shard_limit entries, and when nodes have
+     * been removed since it was last used.
+     */
+    struct count_shard
+    {
+        std::unordered_map<node_ptr, path_count> counts;
+        size_t generation;
+        utilities::mutex mutex;
+
+        count_shard()
+            : generation(0)
+        { }
+    };
+    static const size_type count_shards = 16;
+    static const size_type count_shard_limit = size_type(1) << 16;
+    count_shard m_counts[count_shards];
+
+    // The slot of a node in the table of its shard is taken from the lowest bits.
+    static size_type shard_index(size_t hash)
+    {
+        return shard_bits ? hash >> (sizeof(size_t) * 8 - shard_bits) : 0;
+    }
+
+    static void check_policy(const memory_policy& policy)
+    {
+#ifdef MDD_THREAD_SAFE
+        if (policy.dead_ratio != 0)
+            throw std::invalid_argument("memory_policy::dead_ratio is not supported with MDD_THREAD_SAFE.");
+#else
+        (void)policy;
+#endif
+    }
+
+    // The callback is called without holding the lock, so that it can release nodes.
+    void check_budget()
+    {
+        if (m_policy.byte_budget == 0)
+            return;
+        size_type required = bytes();
+        if (required <= m_policy.byte_budget)
+            return;
+        if (m_policy.budget_callback)
+            m_policy.budget_callback(required);
+        else
+            throw budget_exceeded(required, m_policy.byte_budget);
+    }
 public:
 
     /*************************************************************************************************
      * Memory management operations and node creation.
      *************************************************************************************************/
 
-    node_ptr empty() { return &m_sentinels[0]; }
-    node_ptr emptylist() { return &m_sentinels[1]; }
+    node_ptr empty() { return m_sentinels[0]; }
+    node_ptr emptylist() { return m_sentinels[1]; }
 
     /**
      * @brief Creates a new node (\p val, \p right, \p down).
@@ -71,67 +338,315 @@ public:
     {
         if (down == empty())
             return right;
-        node_ptr newnode = new node_type(val, right, down, 1);
-        auto result = m_nodes.insert(newnode);
-        if (!result.second)
+        size_t hash = typename node_type::hash()(val, right, down);
+        shard& sh = m_shards[shard_index(hash)];
+        utilities::lock_guard lock(sh.mutex);
+        size_type slot;
+        node_ptr newnode = sh.nodes.find(val, right, down, hash, slot);
+        if (newnode)
         {
-            delete newnode;
-            newnode = *result.first;
-            if (newnode->usecount != 0)
-            {
-                right->unuse();
-                down->unuse();
-            }
-            newnode->use();
+#ifndef MDD_MARK_SWEEP
+            // The node already holds references to its children, even if it is dead.
+            right->unuse();
+            down->unuse();
+            newnode->acquire();
+#endif
         }
-#ifdef DEBUG_MDD_NODES
         else
         {
-        std::cout << "Created " << newnode << "(" << newnode->value << ", "
-                  << newnode->right << ", " << newnode->down << ")@"
-                  << newnode->usecount << std::endl;
-        }
+#ifdef MDD_MARK_SWEEP
+            newnode = sh.arena.create(val, right, down, 0);
+#else
+            newnode = sh.arena.create(val, right, down, 1);
 #endif
+            sh.nodes.insert(slot, hash, newnode);
+#ifdef DEBUG_MDD_NODES
+            std::cout << "Created " << newnode << "(" << newnode->value << ", "
+                      << newnode->right << ", " << newnode->down << ")@"
+                      << newnode->usecount << std::endl;
+#endif
+        }
         return newnode;
     }
 
+    /**
+     * @brief Returns the node with the value of \p a and the given children, which is \p a
+     *        itself if the children did not change. Takes ownership of \p right and
+     *        \p down, as create() does.
+     * @param a The node that is rebuilt.
+     * @param right The new MDD node that continues the level of \p a.
+     * @param down The new MDD node that represents the next level.
+     */
+    node_ptr rebuild(node_ptr a, node_ptr right, node_ptr down)
+    {
+        if (right == a->right && down == a->down)
+        {
+            right->unuse();
+            down->unuse();
+            return a->use();
+        }
+        return create(a->value, right, down);
+    }
+
     /**
      * @brief Constructor.
+     * @param policy The memory management policy of the factory.
+     * @param cache The configuration of the operation cache.
+     * @throw std::invalid_argument if \p policy is not supported (see memory_policy).
+     */
+    node_factory(const memory_policy& policy = memory_policy(), const cache_config& cache = cache_config())
+        : m_generation(0), m_cache(cache, &m_generation), m_policy(policy), m_cache_limit(policy.cache_node_limit)
+#ifndef MDD_THREAD_SAFE
+        , m_depth(0)
+#endif
+#if !defined(MDD_THREAD_SAFE) && !defined(MDD_MARK_SWEEP)
+        , m_unused(0), m_unused_scanned()
+#endif
+#ifdef MDD_MARK_SWEEP
+        , m_gc_threshold(1 << 20)
+#endif
+    {
+        check_policy(policy);
+        // The sentinels come from the arena, so that nodes can refer to them by index.
+        m_sentinels[0] = m_shards[0].arena.create();
+        m_sentinels[1] = m_shards[0].arena.create();
+    }
+
+    node_factory(const node_factory&) = delete;
+    node_factory& operator=(const node_factory&) = delete;
+
+    /**
+     * @brief Destructor. Any MDD created by this factory becomes invalid.
      */
-    node_factory()
-    {}
+    ~node_factory()
+    {
+        for (auto& sh: m_shards)
+            for (auto it = sh.nodes.begin(); it != sh.nodes.end(); ++it)
+                sh.arena.destroy(*it);
+        ++node_generation();
+    }
 
     /**
      * @brief Returns the amount of MDD nodes that reside in memory. This includes unused
      *        nodes (use clean() to remove these).
      * @return The number of MDD nodes in memory.
      */
-    size_type size() { return m_nodes.size(); }
+    size_type size()
+    {
+        size_type result = 0;
+        for (auto& sh: m_shards)
+        {
+            utilities::lock_guard lock(sh.mutex);
+            result += sh.nodes.size();
+        }
+        return result;
+    }
 
     /**
-     * @brief Removes all unused nodes from the storage. Note that it is necessary to
-     *        either remove *all* unused nodes, or remove none: if an unused node is
-     *        removed that is still used by another unused node that is not removed,
-     *        then undeleting the latter will cause problems.
+     * @brief Removes all unused nodes from the storage and returns their memory to the
+     *        node arena.
+     *        When compiled with MDD_MARK_SWEEP, this performs a full collection: all
+     *        nodes that are not reachable from a root are freed, and the operation cache
+     *        is cleared.
+     * @warning When compiled with MDD_THREAD_SAFE, clean() must not run while other threads
+     *          are using MDDs from this factory.
      */
     void clean()
     {
-        for (auto it = m_nodes.begin(); it != m_nodes.end();)
+        clean(std::numeric_limits<size_type>::max());
+    }
+
+    /**
+     * @brief Removes at most \p budget unused nodes from the storage. Nodes whose
+     *        reference count dropped to zero are kept on a list, so the time this takes
+     *        is proportional to the number of nodes removed, not to the size of the
+     *        storage. A node is only removed once no other node refers to it, so the
+     *        storage stays consistent after every call.
+     *        When compiled with MDD_MARK_SWEEP, the budget is ignored and a full
+     *        collection is performed.
+     * @param budget The maximum number of nodes to remove.
+     * @return The number of nodes that were removed.
+     * @warning When compiled with MDD_THREAD_SAFE, clean() must not run while other threads
+     *          are using MDDs from this factory.
+     */
+    size_type clean(size_type budget)
+    {
+        size_type removed = 0;
+#ifdef MDD_MARK_SWEEP
+        (void)budget;
+        mark();
+        m_cache.clear();
+        for (auto& sh: m_shards)
+        {
+            for (auto it = sh.nodes.begin(); it != sh.nodes.end();)
+            {
+                if ((*it)->usecount == 0)
+                {
+                    node_ptr node = *it;
+                    it = sh.nodes.erase(it);
+                    sh.arena.destroy(node);
+                    ++removed;
+                }
+                else
+                    ++it;
+            }
+            // Unmarking is done in a separate pass, as erase() may revisit nodes.
+            for (auto it = sh.nodes.begin(); it != sh.nodes.end(); ++it)
+                (*it)->usecount = 0;
+        }
+        if (m_gc_threshold < 2 * size())
+            m_gc_threshold = 2 * size();
+#else
+        // Freeing a node may retire its children in other shards, so the shards are
+        // visited until none of them has dead nodes left.
+        for (bool found = true; found && removed < budget;)
+        {
+            found = false;
+            for (auto& sh: m_shards)
+            {
+                utilities::lock_guard lock(sh.mutex);
+                node_ptr node;
+                while (removed < budget && sh.arena.pop_retired(node))
+                {
+                    found = true;
+                    // The node may have been used again after it was retired.
+                    if (node->references() != 0)
+                    {
+                        node->usecount &= ~node_type::dead_bit;
+                        continue;
+                    }
+                    // Its parents are gone, so it can leave the table before its children
+                    // do. Children that are no longer referenced are retired, and freed by
+                    // this or a later call.
+                    node_ptr right = node->right, down = node->down;
+                    sh.nodes.erase(node);
+                    sh.arena.destroy(node);
+                    right->unuse();
+                    down->unuse();
+                    ++removed;
+                }
+            }
+        }
+#ifndef MDD_THREAD_SAFE
+        m_unused = 0;
+        std::fill(m_unused_scanned, m_unused_scanned + shard_count, 0);
+        m_unused_refs.clear();
+#endif
+#endif
+        // Cache entries may refer to the removed nodes.
+        if (removed)
+            ++m_generation;
+        return removed;
+    }
+
+    /**
+     * @brief Returns a counter that is incremented whenever this factory frees nodes, for
+     *        caches that refer to its nodes.
+     */
+    const std::atomic<size_t>& generation() const
+    {
+        return m_generation;
+    }
+
+    /**
+     * @brief Signals that no operation on the nodes of this factory is in progress, and
+     *        applies the memory policy. When compiled with MDD_MARK_SWEEP, this also starts
+     *        a collection if the number of nodes has reached the collection threshold.
+     */
+    void safe_point()
+    {
+#ifndef MDD_THREAD_SAFE
+        if (m_depth != 0)
+            return;
+#endif
+        bool cleared = m_policy.cache_node_limit != 0 && size() > m_cache_limit;
+        if (cleared)
+            clear_cache();
+#ifdef MDD_MARK_SWEEP
+        if (size() >= m_gc_threshold)
+            clean();
+#elif !defined(MDD_THREAD_SAFE)
+        if (m_policy.dead_ratio > 0 && unused() > m_policy.dead_ratio * size())
+            clean();
+#endif
+        if (cleared)
+            m_cache_limit = size() + m_policy.cache_node_limit;
+    }
+
+    /**
+     * @brief Returns the memory management policy of the factory.
+     */
+    const memory_policy& policy() const
+    {
+        return m_policy;
+    }
+
+    /**
+     * @brief Replaces the memory management policy of the factory.
+     * @throw std::invalid_argument if \p policy is not supported (see memory_policy).
+     * @warning When compiled with MDD_THREAD_SAFE, this must not be called while other
+     *          threads are using MDDs from this factory.
+     */
+    void policy(const memory_policy& policy)
+    {
+        check_policy(policy);
+        m_policy = policy;
+        m_cache_limit = size() + policy.cache_node_limit;
+    }
+
+#ifdef MDD_MARK_SWEEP
+    /**
+     * @brief Sets the number of nodes at which a collection is started automatically. After
+     *        each collection, the threshold is raised to twice the number of surviving
+     *        nodes if it is lower than that.
+     */
+    void gc_threshold(size_type nodes)
+    {
+        m_gc_threshold = nodes;
+    }
+#endif
+
+    /**
+     * @brief Returns the number of bytes reserved for MDD nodes.
+     */
+    size_type node_bytes() const
+    {
+        size_type result = 0;
+        for (auto& sh: m_shards)
+        {
+            utilities::lock_guard lock(sh.mutex);
+            result += sh.arena.bytes();
+        }
+        return result;
+    }
+
+    /**
+     * @brief Returns the number of bytes used by the node storage, that is, the memory
+     *        reserved for nodes plus the memory of the unique table.
+     */
+    size_type bytes()
+    {
+        size_type result = 0;
+        for (auto& sh: m_shards)
         {
-            if ((*it)->usecount == 0)
-                it = m_nodes.erase(it);
-            else
-                ++it;
+            utilities::lock_guard lock(sh.mutex);
+            result += sh.arena.bytes() + sh.nodes.bytes();
         }
+        return result;
     }
 
     /**
-     * @brief Clears the cache. This does not remove any nodes from the storage; to free
-     *        memory after a cache clear, use clean().
+     * @brief Invalidates all entries of the cache, and forgets the memoized sizes of MDDs.
+     *        Neither keeps nodes alive, so this is not needed to free nodes.
      */
     void clear_cache()
     {
         m_cache.clear();
+        for (auto& shard: m_counts)
+        {
+            utilities::lock_guard lock(shard.mutex);
+            shard.counts.clear();
+        }
     }
 
     /**
@@ -154,6 +669,88 @@ public:
         return m_cache.misses();
     }
 
+    /**
+     * @brief Returns the number of cache hits of operation \p op.
+     */
+    size_type cache_hits(cache_operation op) const
+    {
+        return m_cache.hits(op);
+    }
+
+    /**
+     * @brief Returns the number of cache misses of operation \p op.
+     */
+    size_type cache_misses(cache_operation op) const
+    {
+        return m_cache.misses(op);
+    }
+
+    /**
+     * @brief Returns the current number of cache entries reserved for operation \p op.
+     */
+    size_type cache_capacity(cache_operation op) const
+    {
+        return m_cache.capacity(op);
+    }
+
+private:
+#ifdef MDD_MARK_SWEEP
+    void mark()
+    {
+        std::vector<node_ptr> stack;
+        for (root* r = m_roots.m_next; r != &m_roots; r = r->m_next)
+            stack.push_back(*r->m_node);
+        while (!stack.empty())
+        {
+            node_ptr node = stack.back();
+            stack.pop_back();
+            if (node->sentinel() || node->usecount != 0)
+                continue;
+            node->usecount = 1;
+            stack.push_back(node->right);
+            stack.push_back(node->down);
+        }
+    }
+#elif !defined(MDD_THREAD_SAFE)
+    /*
+     * Estimates the number of unused nodes. A dead node keeps its children until it is
+     * freed, so this follows the releases that clean() would do: every dead node is
+     * counted, and so is every node all of whose references come from counted nodes.
+     * Every dead node is only visited once between calls to clean().
+     */
+    size_type unused()
+    {
+        std::vector<node_ptr> stack;
+        for (size_type i = 0; i < shard_count; ++i)
+        {
+            const node_arena<node_type>& arena = m_shards[i].arena;
+            for (; m_unused_scanned[i] < arena.retired(); ++m_unused_scanned[i])
+            {
+                stack.push_back(arena.retired(m_unused_scanned[i]));
+                while (!stack.empty())
+                {
+                    node_ptr node = stack.back();
+                    stack.pop_back();
+                    ++m_unused;
+                    for (node_ptr child: { node->right, node->down })
+                    {
+                        if (child->sentinel())
+                            continue;
+                        auto it = m_unused_refs.insert(std::make_pair(child, 0)).first;
+                        if (++it->second == child->references())
+                        {
+                            m_unused_refs.erase(it);
+                            stack.push_back(child);
+                        }
+                    }
+                }
+            }
+        }
+        return m_unused;
+    }
+#endif
+public:
+
     // For debugging purposes
     /**
      * @brief Dumps the contents of the node buffer to stream s.
@@ -165,29 +762,33 @@ public:
     {
         std::unordered_map<node_ptr, uintptr_t> nummap;
         uintptr_t last = 1;
-        for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it)
-        {
-            node_ptr node = *it;
-            uintptr_t& num = nummap[node];
-            if (num == 0) num = last++;
-            uintptr_t& numr = nummap[node->right];
-            if (!node->right->sentinel() && numr == 0) numr = last++;
-            uintptr_t& numd = nummap[node->down];
-            if (!node->down->sentinel() && numd == 0) numd = last++;
-
-            s << num;
-            if (node == hint1)
-                s << "*";
-            if (node == hint2)
-                s << "+";
-            s << "(" << node->value << ", ";
-            if (node->right == empty()) s << "FALSE, "; else
-            if (node->right == emptylist()) s << "TRUE, "; else
-                s << numr << ", ";
-            if (node->down == empty()) s << "FALSE)@"; else
-            if (node->down == emptylist()) s << "TRUE)@"; else
-                s << numd << ")@";
-            s << node->usecount << std::endl;
+        for (auto& sh: m_shards)
+        {
+            utilities::lock_guard lock(sh.mutex);
+            for (auto it = sh.nodes.begin(); it != sh.nodes.end(); ++it)
+            {
+                node_ptr node = *it;
+                uintptr_t& num = nummap[node];
+                if (num == 0) num = last++;
+                uintptr_t& numr = nummap[node->right];
+                if (!node->right->sentinel() && numr == 0) numr = last++;
+                uintptr_t& numd = nummap[node->down];
+                if (!node->down->sentinel() && numd == 0) numd = last++;
+
+                s << num;
+                if (node == hint1)
+                    s << "*";
+                if (node == hint2)
+                    s << "+";
+                s << "(" << node->value << ", ";
+                if (node->right == empty()) s << "FALSE, "; else
+                if (node->right == emptylist()) s << "TRUE, "; else
+                    s << numr << ", ";
+                if (node->down == empty()) s << "FALSE)@"; else
+                if (node->down == emptylist()) s << "TRUE)@"; else
+                    s << numd << ")@";
+                s << node->usecount << std::endl;
+            }
         }
     }
 
@@ -39,19 +39,16 @@ struct node_factory<Value>::mdd_add_element
             result = m_factory.create(*begin, a->use(), temp);
         }
         else
+        if (a->value == *begin)
         {
-            if (a->value == *begin)
-            {
-                iterator next(begin);
-                temp = operator()(a->down, ++next, end);
-                result = m_factory.create(a->value, a->right->use(), temp);
-            }
-            else
-            if (a->value < *begin)
-            {
-                temp = operator()(a->right, begin, end);
-                result = m_factory.create(a->value, temp, a->down->use());
-            }
+            iterator next(begin);
+            temp = operator()(a->down, ++next, end);
+            result = m_factory.create(a->value, a->right->use(), temp);
+        }
+        else // a->value < *begin
+        {
+            temp = operator()(a->right, begin, end);
+            result = m_factory.create(a->value, temp, a->down->use());
         }
         return result;
     }
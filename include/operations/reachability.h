@@ -0,0 +1,274 @@
+#ifndef __scranen_mdd_operations_reachability_h
+#define __scranen_mdd_operations_reachability_h
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "mdd.h"
+#include "projection.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Order in which a reachability analysis applies the partitions of the relation.
+ */
+enum reachability_strategy
+{
+    /// Every iteration applies all partitions to the same set, and then merges the results.
+    reach_bfs,
+    /// Every partition is applied to the set that includes the images of the partitions
+    /// before it in the same iteration. This usually needs far fewer iterations.
+    reach_chaining,
+    /// Saturation (see node_factory::mdd_rel_saturate). Partitions are fired bottom-up at
+    /// the topmost level of their projection, which is usually much faster and needs far
+    /// less memory when partitions only touch a few levels. All states must have the same
+    /// length. The whole analysis is reported as a single iteration.
+    reach_saturation
+};
+
+/**
+ * @brief The set to which a reachability analysis applies the relation. Ignored by
+ *        reach_saturation.
+ */
+enum reachability_image
+{
+    /// Only the states that were found in the previous iteration.
+    image_frontier,
+    /// All states found so far. The sets involved are larger, but often have smaller MDDs.
+    image_full
+};
+
+/**
+ * @brief Statistics of a single iteration of a reachability analysis.
+ *
+ * The states, set_nodes and nodes fields each need a traversal of the reached set or the
+ * factory, so they are only filled in for the last iteration unless
+ * reachability::collect_statistics() was enabled. They are zero for the other iterations.
+ */
+struct reachability_step
+{
+    /// The time taken by the iteration, in seconds.
+    double seconds;
+    /// The number of vectors reached after the iteration.
+    path_count states;
+    /// The number of nodes of the reached set after the iteration.
+    size_t set_nodes;
+    /// The number of nodes in the factory after the iteration.
+    size_t nodes;
+    /// The number of cache hits during the iteration.
+    size_t cache_hits;
+    /// The number of cache misses during the iteration.
+    size_t cache_misses;
+
+    double hit_rate() const
+    {
+        return cache_hits + cache_misses ? double(cache_hits) / (cache_hits + cache_misses) : 0;
+    }
+};
+
+/**
+ * @brief Computes the set of states reachable from an initial set with a partitioned
+ *        transition relation.
+ *
+ * The relation is given as a number of interleaved relations, each with an optional
+ * projection that lists the levels it reads and writes (see mdd_irel::operator()()). The
+ * order in which partitions are applied, and the set they are applied to, are set with a
+ * reachability_strategy and a reachability_image.
+ *
+ * Example usage:
+ * \code
+ * mdd::reachability<int> reach(mdd::reach_chaining, mdd::image_frontier);
+ * reach.add(r1, p1);
+ * reach.add(r2, p2);
+ * mdd::mdd<int> states = reach(initial);
+ * for (auto& step : reach.statistics())
+ *     std::cout << step.seconds << " " << double(step.states) << std::endl;
+ * \endcode
+ */
+template <typename Value>
+class reachability
+{
+public:
+    typedef mdd<Value> set_type;
+    typedef mdd_irel<Value> rel_type;
+
+    reachability(reachability_strategy strategy = reach_chaining, reachability_image image = image_frontier)
+        : m_strategy(strategy), m_image(image), m_collect(false), m_token(saturate_type::new_token())
+    { }
+
+    /**
+     * @brief Sets whether the sizes in reachability_step are computed for every iteration,
+     *        instead of only for the last one. This is off by default, as counting the
+     *        reached set can take longer than the iteration itself.
+     */
+    void collect_statistics(bool collect)
+    {
+        m_collect = collect;
+    }
+
+    /**
+     * @brief Adds a partition of the relation that applies to all levels.
+     */
+    void add(const rel_type& relation)
+    {
+        m_partitions.push_back(partition(relation, nullptr));
+        m_token = saturate_type::new_token();
+    }
+
+    /**
+     * @brief Adds a partition of the relation that applies to the levels in \p proj.
+     */
+    void add(const rel_type& relation, const projection& proj)
+    {
+        m_partitions.push_back(partition(relation, std::make_shared<projection>(proj)));
+        m_token = saturate_type::new_token();
+    }
+
+    /**
+     * @brief Returns the set of states reachable from \p initial. Statistics of every
+     *        iteration are available from statistics() afterwards.
+     */
+    set_type operator()(const set_type& initial)
+    {
+        m_statistics.clear();
+        if (m_strategy == reach_saturation)
+            return saturation(initial);
+        set_type reached(initial);
+        set_type frontier(initial);
+        bool changed = true;
+        while (changed)
+        {
+            step_timer timer(reached.m_factory);
+            set_type found = m_strategy == reach_bfs ? bfs(reached, frontier) : chaining(reached, frontier);
+            changed = found != reached.m_factory->empty_set();
+            if (m_image == image_frontier)
+                frontier = found;
+            m_statistics.push_back(timer.finish(reached, m_collect || !changed));
+        }
+        return reached;
+    }
+
+    /**
+     * @brief Returns the statistics of the iterations of the last call to operator()(). The
+     *        last iteration is the one that found no new states.
+     */
+    const std::vector<reachability_step>& statistics() const
+    {
+        return m_statistics;
+    }
+private:
+    struct partition
+    {
+        rel_type relation;
+        std::shared_ptr<projection> proj;
+
+        partition(const rel_type& relation, const std::shared_ptr<projection>& proj)
+            : relation(relation), proj(proj)
+        { }
+    };
+
+    typedef typename mdd_factory<Value>::parent::mdd_rel_saturate saturate_type;
+    typedef typename mdd_factory<Value>::parent::mdd_rel_next_multi next_multi_type;
+
+    class step_timer
+    {
+    public:
+        step_timer(mdd_factory<Value>* factory)
+            : m_factory(factory), m_hits(factory->cache_hits()), m_misses(factory->cache_misses()),
+              m_start(std::chrono::steady_clock::now())
+        { }
+
+        /*
+         * Returns the statistics of the step. The sizes are only computed if \p sizes is true.
+         */
+        reachability_step finish(set_type& reached, bool sizes)
+        {
+            reachability_step step;
+            step.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            step.states = 0;
+            step.set_nodes = 0;
+            step.nodes = 0;
+            if (sizes)
+            {
+                step.states = reached.count();
+                reached.size(step.set_nodes);
+                step.nodes = m_factory->size();
+            }
+            step.cache_hits = m_factory->cache_hits() - m_hits;
+            step.cache_misses = m_factory->cache_misses() - m_misses;
+            return step;
+        }
+    private:
+        mdd_factory<Value>* m_factory;
+        size_t m_hits;
+        size_t m_misses;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    /*
+     * Returns the partitions sorted by their top level, as saturation and the multi-partition
+     * image expect them.
+     */
+    std::vector<typename saturate_type::partition> sorted_partitions() const
+    {
+        typedef typename mdd_factory<Value>::node_ptr node_ptr;
+        return next_multi_type::sort_partitions(m_partitions.begin(), m_partitions.end(), [](const partition& p) {
+            return std::pair<node_ptr, const projection*>(p.relation.m_node, p.proj.get());
+        });
+    }
+
+    set_type saturation(const set_type& initial)
+    {
+        step_timer timer(initial.m_factory);
+        set_type reached(initial.m_factory, initial.template invoke<saturate_type>(sorted_partitions(), m_token));
+        m_statistics.push_back(timer.finish(reached, true));
+        return reached;
+    }
+
+    /*
+     * Returns the image of states under p without visited.
+     */
+    set_type image_minus(partition& p, const set_type& states, const set_type& visited)
+    {
+        return p.proj ? p.relation.next_minus(states, visited, *p.proj) : p.relation.next_minus(states, visited);
+    }
+
+    /*
+     * Both strategies add the new states to reached, and return them.
+     */
+    set_type bfs(set_type& reached, const set_type& frontier)
+    {
+        const set_type& source = m_image == image_frontier ? frontier : reached;
+        set_type next(reached.m_factory, source.template invoke<next_multi_type>(sorted_partitions(), m_token, reached.m_node));
+        reached |= next;
+        return next;
+    }
+
+    set_type chaining(set_type& reached, const set_type& frontier)
+    {
+        set_type found = reached.m_factory->empty_set();
+        set_type current = m_image == image_frontier ? frontier : reached;
+        for (auto it = m_partitions.begin(); it != m_partitions.end(); ++it)
+        {
+            set_type next = image_minus(*it, current, reached);
+            reached |= next;
+            found |= next;
+            current = m_image == image_frontier ? current | next : reached;
+        }
+        return found;
+    }
+
+    reachability_strategy m_strategy;
+    reachability_image m_image;
+    bool m_collect;
+    typename saturate_type::key_type m_token;
+    std::vector<partition> m_partitions;
+    std::vector<reachability_step> m_statistics;
+};
+
+}
+
+#endif // __scranen_mdd_operations_reachability_h
@@ -80,7 +80,7 @@ private:
             return match_i_i(a->down, b);
 
         if (m_factory.m_cache.lookup(cache_rel_composition_i_i, a, b, result))
-            return result->use();
+            return result;
 
         node_ptr r_right = compose_i_i(a->right, b);
         node_ptr r_down = match_i_i(a->down, b);
@@ -131,7 +131,7 @@ private:
         assert(b != m_factory.emptylist());
 
         if (m_factory.m_cache.lookup(cache_rel_composition_i_s, a, b, result))
-            return result->use();
+            return result;
 
         node_ptr r_right = compose_i_s(a->right, b);
         node_ptr r_down = match_i_s(a->down, b);
@@ -195,7 +195,7 @@ private:
         assert(b != m_factory.emptylist());
 
         if (m_factory.m_cache.lookup(cache_rel_composition_i_s, a, b, pbegin, result))
-            return result->use();
+            return result;
 
         if (*pbegin == level)
         {
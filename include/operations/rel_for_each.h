@@ -0,0 +1,74 @@
+#ifndef __scranen_mdd_operations_rel_for_each_h
+#define __scranen_mdd_operations_rel_for_each_h
+
+#include <stdexcept>
+#include <vector>
+
+#include "node_factory.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Enumerates the pairs in an interleaved relation by calling back for each of them.
+ *
+ * The levels of an interleaved relation alternate between source and target values. The
+ * traversal pushes the values of even levels onto a source buffer and those of odd levels
+ * onto a target buffer, so that the pairs are de-interleaved without copying, and without
+ * allocating memory once the buffers have grown to the depth of the relation. A relation
+ * built for a projection only contains the projected levels, so only those are reported.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_rel_for_each
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef std::vector<Value> vector_type;
+
+    factory_type& m_factory;
+    vector_type m_src;
+    vector_type m_dst;
+
+    mdd_rel_for_each(factory_type& factory)
+        : m_factory(factory)
+    {
+        m_src.reserve(32);
+        m_dst.reserve(32);
+    }
+
+    /**
+     * @brief Calls \p pair with the source and target vector of every pair in \p p, until
+     *        it returns false.
+     * @return False if the enumeration was ended by \p pair, true otherwise.
+     * @throw std::runtime_error if \p p contains a vector of odd length.
+     */
+    template <typename PairCallback>
+    bool operator()(node_ptr p, PairCallback& pair)
+    {
+        m_src.clear();
+        m_dst.clear();
+        return visit(p, pair, false);
+    }
+private:
+    template <typename PairCallback>
+    bool visit(node_ptr p, PairCallback& pair, bool target)
+    {
+        vector_type& path = target ? m_dst : m_src;
+        for (; !p->sentinel(); p = p->right)
+        {
+            path.push_back(p->value);
+            if (!visit(p->down, pair, !target))
+                return false;
+            path.pop_back();
+        }
+        if (p != m_factory.emptylist())
+            return true;
+        if (target)
+            throw std::runtime_error("Interleaved relation contains a vector of odd length.");
+        return pair(static_cast<const vector_type&>(m_src), static_cast<const vector_type&>(m_dst));
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_rel_for_each_h
@@ -40,6 +40,12 @@ struct node_factory<Value>::mdd_rel_next
             return next(r, s);
         return next(r, s, proj.begin(), proj.end());
     }
+
+    // Same as above, where s starts at the level of the projection that pbegin points to
+    node_ptr operator()(node_ptr r, node_ptr s, projection::iterator pbegin, projection::iterator pend)
+    {
+        return next(r, s, pbegin, pend);
+    }
 private:
 
     /*
@@ -58,7 +64,7 @@ private:
         node_ptr result;
         projection::iterator oldbegin = pbegin;
         if (m_factory.m_cache.lookup(cache_rel_next, r, s, oldbegin.node(), result))
-            return result->use();
+            return result;
 
         if (pbegin == pend || !*pbegin)
             result = collect_wildcard(r, s, ++pbegin, pend);
@@ -114,7 +120,7 @@ private:
 
         node_ptr result;
         if (m_factory.m_cache.lookup(cache_rel_next, r, s, result))
-            return result->use();
+            return result;
 
         if (s->value < r->value)
             result = next(r, s->right);
@@ -0,0 +1,172 @@
+#ifndef __scranen_mdd_operations_rel_next_minus_h
+#define __scranen_mdd_operations_rel_next_minus_h
+
+#include "node_factory.h"
+#include "projection.h"
+#include "rel_next.h"
+#include "set_minus.h"
+#include "set_union.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Computes next(r, s) - v in a single traversal.
+ *
+ * The traversal follows mdd_rel_next, but descends into \p v along with every successor
+ * it creates, so that successors in \p v are never built. This is the new frontier of a
+ * breadth-first search when \p v holds the states visited so far. Results are cached on
+ * all three operands.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_rel_next_minus
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef typename factory_type::cache_type cache_type;
+    typedef typename factory_type::mdd_rel_next rel_next;
+    typedef typename factory_type::mdd_set_minus set_minus;
+    typedef typename factory_type::mdd_set_union set_union;
+
+    factory_type& m_factory;
+
+    mdd_rel_next_minus(factory_type& factory)
+        : m_factory(factory)
+    { }
+
+    // Compute the states reachable from s using one step of interleaved relation r, that are not in v
+    node_ptr operator()(node_ptr r, node_ptr s, node_ptr v)
+    {
+        return next(r, s, v);
+    }
+
+    // Same as above, for an interleaved partial relation r
+    node_ptr operator()(node_ptr r, node_ptr s, node_ptr v, const projection& proj)
+    {
+        if (proj.full())
+            return next(r, s, v);
+        return next(r, s, v, proj.begin(), proj.end());
+    }
+
+    // Same as above, for the levels of a projection from pbegin on
+    node_ptr operator()(node_ptr r, node_ptr s, node_ptr v, projection::iterator pbegin, projection::iterator pend)
+    {
+        return next(r, s, v, pbegin, pend);
+    }
+private:
+    /*
+     * Skips the nodes in the list v with a value below \p value, and returns the child of
+     * the node with that value, or empty if there is none.
+     */
+    node_ptr child(node_ptr& v, const Value& value)
+    {
+        while (!v->sentinel() && v->value < value)
+            v = v->right;
+        return v->sentinel() || value < v->value ? m_factory.empty() : v->down;
+    }
+
+    /*
+     * Version with projection
+     */
+
+    node_ptr next(node_ptr r, node_ptr s, node_ptr v, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (v == m_factory.empty())
+            return rel_next(m_factory)(r, s, pbegin, pend);
+        if (r == m_factory.empty() || s == m_factory.empty())
+            return m_factory.empty();
+        if (r == m_factory.emptylist() || s->sentinel())
+            return set_minus(m_factory)(s, v);
+
+        node_ptr result;
+        projection::iterator oldbegin = pbegin;
+        if (m_factory.m_cache.lookup(cache_rel_next_minus, r, s, oldbegin.node(), v, result))
+            return result;
+
+        if (pbegin == pend || !*pbegin)
+            result = collect_wildcard(r, s, v, ++pbegin, pend);
+        else
+        if (s->value < r->value)
+            result = next(r, s->right, v, pbegin, pend);
+        else
+        if (s->value > r->value)
+            result = next(r->right, s, v, pbegin, pend);
+        else
+        {
+            node_ptr right = next(r->right, s->right, v, pbegin, pend);
+            node_ptr down = collect(r->down, s, v, ++pbegin, pend);
+            result = set_union(m_factory)(right, down);
+            right->unuse();
+            down->unuse();
+        }
+
+        m_factory.m_cache.store(cache_rel_next_minus, r, s, oldbegin.node(), v, result);
+        return result;
+    }
+
+    node_ptr collect_wildcard(node_ptr r, node_ptr s, node_ptr v, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (s->sentinel())
+            return set_minus(m_factory)(s, v);
+
+        node_ptr down = next(r, s->down, child(v, s->value), pbegin, pend);
+        return m_factory.create(s->value, collect_wildcard(r, s->right, v, pbegin, pend), down);
+    }
+
+    node_ptr collect(node_ptr r, node_ptr s, node_ptr v, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (r->sentinel())
+            return set_minus(m_factory)(r, v);
+
+        node_ptr down = next(r->down, s->down, child(v, r->value), pbegin, pend);
+        return m_factory.create(r->value, collect(r->right, s, v, pbegin, pend), down);
+    }
+
+    /*
+     * Version without projection
+     */
+
+    node_ptr next(node_ptr r, node_ptr s, node_ptr v)
+    {
+        if (v == m_factory.empty())
+            return rel_next(m_factory)(r, s);
+        if (r == m_factory.empty() || s == m_factory.empty())
+            return m_factory.empty();
+        if (r == m_factory.emptylist() || s->sentinel())
+            return set_minus(m_factory)(s, v);
+
+        node_ptr result;
+        if (m_factory.m_cache.lookup(cache_rel_next_minus, r, s, nullptr, v, result))
+            return result;
+
+        if (s->value < r->value)
+            result = next(r, s->right, v);
+        else
+        if (s->value > r->value)
+            result = next(r->right, s, v);
+        else
+        {
+            node_ptr right = next(r->right, s->right, v);
+            node_ptr down = collect(r->down, s, v);
+            result = set_union(m_factory)(right, down);
+            right->unuse();
+            down->unuse();
+        }
+
+        m_factory.m_cache.store(cache_rel_next_minus, r, s, nullptr, v, result);
+        return result;
+    }
+
+    node_ptr collect(node_ptr r, node_ptr s, node_ptr v)
+    {
+        if (r->sentinel())
+            return set_minus(m_factory)(r, v);
+
+        node_ptr down = next(r->down, s->down, child(v, r->value));
+        return m_factory.create(r->value, collect(r->right, s, v), down);
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_rel_next_minus_h
@@ -0,0 +1,201 @@
+#ifndef __scranen_mdd_operations_rel_next_multi_h
+#define __scranen_mdd_operations_rel_next_multi_h
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "node_factory.h"
+#include "projection.h"
+#include "rel_next_minus.h"
+#include "rel_saturate.h"
+#include "set_minus.h"
+#include "set_union.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Computes the states reachable from a set in one step of any of a number of
+ *        partitions of a relation.
+ *
+ * Partitions are sorted by the topmost level of their projection, as in mdd_rel_saturate.
+ * The levels above the top of a partition are copied from the set unchanged, so instead of
+ * computing every image separately and merging them, the set is walked once for all
+ * partitions. At every level, the partitions that start there are fired on the current
+ * list, and their images are merged with the list of images of the partitions that start
+ * further down. Images of sublists are stored per level in the operation cache under a
+ * token that identifies the set of partitions, like mdd_rel_saturate does, or in a memo
+ * that only lasts for the call if no token is given.
+ *
+ * A set of visited states can be given, which is then descended along with the set as
+ * mdd_rel_next_minus does, so that the new frontier of a breadth-first search is computed
+ * in the same walk instead of by a separate difference.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_rel_next_multi
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef typename factory_type::cache_type cache_type;
+    typedef typename cache_type::key_type key_type;
+    typedef typename factory_type::mdd_rel_saturate::partition partition;
+    typedef typename std::vector<partition>::const_iterator partition_iterator;
+
+    factory_type& m_factory;
+    const std::vector<partition>* m_partitions;
+    key_type m_token;
+    std::map<std::tuple<node_ptr, node_ptr, size_t>, node_ptr> m_memo;
+
+    mdd_rel_next_multi(factory_type& factory)
+        : m_factory(factory), m_partitions(nullptr), m_token(0)
+    { }
+
+    ~mdd_rel_next_multi()
+    {
+        for (auto it = m_memo.begin(); it != m_memo.end(); ++it)
+            it->second->unuse();
+    }
+
+    /**
+     * @brief Returns the partitions of the elements of [\p begin, \p end), sorted by their
+     *        top level as operator()() and mdd_rel_saturate expect them.
+     * @param split Returns the relation of an element and its projection, or null if it
+     *        applies to all levels. The projection must outlive the partitions.
+     */
+    template <typename iterator, typename function>
+    static std::vector<partition> sort_partitions(iterator begin, iterator end, function split)
+    {
+        std::vector<partition> partitions;
+        for (; begin != end; ++begin)
+        {
+            std::pair<node_ptr, const projection*> p = split(*begin);
+            partitions.push_back(factory_type::mdd_rel_saturate::make_partition(p.first, p.second));
+        }
+        std::stable_sort(partitions.begin(), partitions.end(),
+                         [](const partition& a, const partition& b) { return a.top < b.top; });
+        return partitions;
+    }
+
+    /**
+     * @brief Returns the union of the images of \p s under \p partitions, which must be
+     *        sorted by their top level, without the states in \p visited.
+     * @param token Identifies \p partitions in the operation cache (see
+     *        mdd_rel_saturate::new_token()), or 0 to keep images for this call only.
+     * @param visited The states to leave out of the result, or null to keep all images.
+     */
+    node_ptr operator()(node_ptr s, const std::vector<partition>& partitions, key_type token = 0, node_ptr visited = nullptr)
+    {
+        if (partitions.empty())
+            return m_factory.empty();
+        m_partitions = &partitions;
+        m_token = token;
+        return next(s, visited ? visited : m_factory.empty(), 0, partitions.begin());
+    }
+private:
+    /*
+     * Returns the images of s under the partitions from first on, none of which start
+     * above level, without the states in v.
+     */
+    node_ptr next(node_ptr s, node_ptr v, size_t level, partition_iterator first)
+    {
+        if (first == m_partitions->end() || s == m_factory.empty())
+            return m_factory.empty();
+        if (s->sentinel())
+            return tail(s, v, first);
+
+        node_ptr result;
+        if (lookup(s, v, level, result))
+            return result;
+
+        partition_iterator last = first;
+        while (last != m_partitions->end() && last->top == level)
+            ++last;
+        result = walk(s, v, level, last);
+        for (; first != last; ++first)
+        {
+            node_ptr image = fire(*first, s, v, level);
+            node_ptr merged = typename factory_type::mdd_set_union(m_factory)(result, image);
+            result->unuse();
+            image->unuse();
+            result = merged;
+        }
+
+        store(s, v, level, result);
+        return result;
+    }
+
+    bool lookup(node_ptr s, node_ptr v, size_t level, node_ptr& result)
+    {
+        if (m_token)
+            return m_factory.m_cache.lookup(cache_rel_next_multi, s, nullptr, nullptr, v,
+                                            factory_type::mdd_rel_saturate::key(m_token, level), result);
+        auto it = m_memo.find(std::make_tuple(s, v, level));
+        if (it == m_memo.end())
+            return false;
+        result = it->second->use();
+        return true;
+    }
+
+    void store(node_ptr s, node_ptr v, size_t level, node_ptr result)
+    {
+        if (m_token)
+            m_factory.m_cache.store(cache_rel_next_multi, s, nullptr, nullptr, v,
+                                    factory_type::mdd_rel_saturate::key(m_token, level), result);
+        else
+            m_memo[std::make_tuple(s, v, level)] = result->use();
+    }
+
+    /*
+     * Returns the images of the list s under the partitions from first on, all of which
+     * start below level, without the states in the list v.
+     */
+    node_ptr walk(node_ptr s, node_ptr v, size_t level, partition_iterator first)
+    {
+        if (first == m_partitions->end())
+            return m_factory.empty();
+        if (s->sentinel())
+            return tail(s, v, first);
+        node_ptr down = next(s->down, child(v, s->value), level + 1, first);
+        return m_factory.create(s->value, walk(s->right, v, level, first), down);
+    }
+
+    /*
+     * Skips the nodes in the list v with a value below \p value, and returns the child of
+     * the node with that value, or empty if there is none.
+     */
+    node_ptr child(node_ptr& v, const Value& value)
+    {
+        while (!v->sentinel() && v->value < value)
+            v = v->right;
+        return v->sentinel() || value < v->value ? m_factory.empty() : v->down;
+    }
+
+    /*
+     * Like mdd_rel_next, a partition maps the empty vector to itself, unless it is empty.
+     */
+    node_ptr tail(node_ptr s, node_ptr v, partition_iterator first)
+    {
+        if (s == m_factory.emptylist())
+            for (; first != m_partitions->end(); ++first)
+                if (first->relation != m_factory.empty())
+                    return typename factory_type::mdd_set_minus(m_factory)(s, v);
+        return m_factory.empty();
+    }
+
+    node_ptr fire(const partition& p, node_ptr s, node_ptr v, size_t level)
+    {
+        typename factory_type::mdd_rel_next_minus next(m_factory);
+        if (!p.proj)
+            return next(p.relation, s, v);
+        projection::iterator begin = p.proj->begin();
+        for (size_t i = 0; i < level; ++i)
+            ++begin;
+        return next(p.relation, s, v, begin, p.proj->end());
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_rel_next_multi_h
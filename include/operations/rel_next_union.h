@@ -0,0 +1,163 @@
+#ifndef __scranen_mdd_operations_rel_next_union_h
+#define __scranen_mdd_operations_rel_next_union_h
+
+#include "node_factory.h"
+#include "projection.h"
+#include "rel_next.h"
+#include "set_union.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Computes v | next(r, s) in a single traversal.
+ *
+ * The traversal follows mdd_rel_next, but every list of successors is merged with the
+ * matching list of \p v while it is being built, instead of merging the complete image
+ * with \p v afterwards. This saves building the image as an intermediate MDD, which
+ * usually shares little with the result. Results are cached on all three operands.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_rel_next_union
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef typename factory_type::cache_type cache_type;
+    typedef typename factory_type::mdd_rel_next rel_next;
+    typedef typename factory_type::mdd_set_union set_union;
+
+    factory_type& m_factory;
+
+    mdd_rel_next_union(factory_type& factory)
+        : m_factory(factory)
+    { }
+
+    // Compute v plus the states reachable from s using one step of interleaved relation r
+    node_ptr operator()(node_ptr r, node_ptr s, node_ptr v)
+    {
+        return next(r, s, v);
+    }
+
+    // Same as above, for an interleaved partial relation r
+    node_ptr operator()(node_ptr r, node_ptr s, node_ptr v, const projection& proj)
+    {
+        if (proj.full())
+            return next(r, s, v);
+        return next(r, s, v, proj.begin(), proj.end());
+    }
+private:
+
+    /*
+     * Version with projection
+     */
+
+    node_ptr next(node_ptr r, node_ptr s, node_ptr v, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (v == m_factory.empty())
+            return rel_next(m_factory)(r, s, pbegin, pend);
+        if (r == m_factory.empty() || s == m_factory.empty())
+            return v->use();
+        if (r == m_factory.emptylist() || s->sentinel())
+            return set_union(m_factory)(s, v);
+
+        node_ptr result;
+        projection::iterator oldbegin = pbegin;
+        if (m_factory.m_cache.lookup(cache_rel_next_union, r, s, oldbegin.node(), v, result))
+            return result;
+
+        if (pbegin == pend || !*pbegin)
+            result = collect_wildcard(r, s, v, ++pbegin, pend);
+        else
+        if (s->value < r->value)
+            result = next(r, s->right, v, pbegin, pend);
+        else
+        if (s->value > r->value)
+            result = next(r->right, s, v, pbegin, pend);
+        else
+        {
+            node_ptr right = next(r->right, s->right, v, pbegin, pend);
+            result = collect(r->down, s, right, ++pbegin, pend);
+            right->unuse();
+        }
+
+        m_factory.m_cache.store(cache_rel_next_union, r, s, oldbegin.node(), v, result);
+        return result;
+    }
+
+    node_ptr collect_wildcard(node_ptr r, node_ptr s, node_ptr v, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (s->sentinel())
+            return set_union(m_factory)(s, v);
+        if (v->sentinel() || s->value < v->value)
+            return m_factory.create(s->value, collect_wildcard(r, s->right, v, pbegin, pend),
+                                    rel_next(m_factory)(r, s->down, pbegin, pend));
+        if (s->value > v->value)
+            return m_factory.create(v->value, collect_wildcard(r, s, v->right, pbegin, pend), v->down->use());
+        return m_factory.create(s->value, collect_wildcard(r, s->right, v->right, pbegin, pend),
+                                next(r, s->down, v->down, pbegin, pend));
+    }
+
+    /*
+     * Merges the targets in r (for source s) with the list v.
+     */
+    node_ptr collect(node_ptr r, node_ptr s, node_ptr v, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (r->sentinel())
+            return set_union(m_factory)(r, v);
+        if (v->sentinel() || r->value < v->value)
+            return m_factory.create(r->value, collect(r->right, s, v, pbegin, pend),
+                                    rel_next(m_factory)(r->down, s->down, pbegin, pend));
+        if (r->value > v->value)
+            return m_factory.create(v->value, collect(r, s, v->right, pbegin, pend), v->down->use());
+        return m_factory.create(r->value, collect(r->right, s, v->right, pbegin, pend),
+                                next(r->down, s->down, v->down, pbegin, pend));
+    }
+
+    /*
+     * Version without projection
+     */
+
+    node_ptr next(node_ptr r, node_ptr s, node_ptr v)
+    {
+        if (v == m_factory.empty())
+            return rel_next(m_factory)(r, s);
+        if (r == m_factory.empty() || s == m_factory.empty())
+            return v->use();
+        if (r == m_factory.emptylist() || s->sentinel())
+            return set_union(m_factory)(s, v);
+
+        node_ptr result;
+        if (m_factory.m_cache.lookup(cache_rel_next_union, r, s, nullptr, v, result))
+            return result;
+
+        if (s->value < r->value)
+            result = next(r, s->right, v);
+        else
+        if (s->value > r->value)
+            result = next(r->right, s, v);
+        else
+        {
+            node_ptr right = next(r->right, s->right, v);
+            result = collect(r->down, s, right);
+            right->unuse();
+        }
+
+        m_factory.m_cache.store(cache_rel_next_union, r, s, nullptr, v, result);
+        return result;
+    }
+
+    node_ptr collect(node_ptr r, node_ptr s, node_ptr v)
+    {
+        if (r->sentinel())
+            return set_union(m_factory)(r, v);
+        if (v->sentinel() || r->value < v->value)
+            return m_factory.create(r->value, collect(r->right, s, v), rel_next(m_factory)(r->down, s->down));
+        if (r->value > v->value)
+            return m_factory.create(v->value, collect(r, s, v->right), v->down->use());
+        return m_factory.create(r->value, collect(r->right, s, v->right), next(r->down, s->down, v->down));
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_rel_next_union_h
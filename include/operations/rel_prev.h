@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include "node_factory.h"
+#include "projection.h"
 
 namespace mdd
 {
@@ -26,7 +27,109 @@ struct node_factory<Value>::mdd_rel_prev
         : m_factory(factory)
     { }
 
+    // Compute states from which s is reachable using one step of interleaved relation r
     node_ptr operator()(node_ptr r, node_ptr s)
+    {
+        return prev(r, s);
+    }
+
+    // Compute states from which s is reachable using one step of interleaved partial relation r
+    node_ptr operator()(node_ptr r, node_ptr s, const projection& proj)
+    {
+        if (proj.full())
+            return prev(r, s);
+        return prev(r, s, proj.begin(), proj.end());
+    }
+private:
+
+    /*
+     * Version with projection
+     */
+
+    node_ptr prev(node_ptr r, node_ptr s, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (r == m_factory.empty())
+            return r;
+        if (r == m_factory.emptylist())
+            return s->use();
+        if (s->sentinel())
+            return s;
+
+        node_ptr result;
+        projection::iterator oldbegin = pbegin;
+        if (m_factory.m_cache.lookup(cache_rel_prev, r, s, oldbegin.node(), result))
+            return result;
+
+        if (pbegin == pend || !*pbegin)
+            result = collect_wildcard(r, s, ++pbegin, pend);
+        else
+        {
+            // The preimage of the empty pair is s itself, which has to be merged with the
+            // whole list rather than put after its last value.
+            bool identity = false;
+            result = pairs(r, s, ++pbegin, pend, identity);
+            if (identity)
+            {
+                node_ptr merged = typename factory_type::mdd_set_union(m_factory)(result, s);
+                result->unuse();
+                result = merged;
+            }
+        }
+
+        m_factory.m_cache.store(cache_rel_prev, r, s, oldbegin.node(), result);
+        return result;
+    }
+
+    /*
+     * Returns the preimages of s under the pairs in the list r, except for the empty pair
+     * that may end it. Sets identity if it does.
+     */
+    node_ptr pairs(node_ptr r, node_ptr s, projection::iterator pbegin, projection::iterator pend, bool& identity)
+    {
+        if (r->sentinel())
+        {
+            identity = r == m_factory.emptylist();
+            return m_factory.empty();
+        }
+
+        node_ptr down = collect(r->down, s, pbegin, pend);
+        return m_factory.create(r->value, pairs(r->right, s, pbegin, pend, identity), down);
+    }
+
+    node_ptr collect_wildcard(node_ptr r, node_ptr s, projection::iterator pbegin, projection::iterator pend)
+    {
+        if (s->sentinel())
+            return s;
+
+        node_ptr down = prev(r, s->down, pbegin, pend);
+        return m_factory.create(s->value, collect_wildcard(r, s->right, pbegin, pend), down);
+    }
+
+    node_ptr collect(node_ptr r, node_ptr s, projection::iterator pbegin, projection::iterator pend)
+    {
+        assert(r != m_factory.emptylist());
+        if (r == m_factory.empty())
+            return r;
+        if (s->sentinel())
+            return m_factory.empty();
+        if (r->value < s->value)
+            return collect(r->right, s, pbegin, pend);
+        if (r->value > s->value)
+            return collect(r, s->right, pbegin, pend);
+
+        node_ptr down = prev(r->down, s->down, pbegin, pend);
+        node_ptr right = collect(r->right, s->right, pbegin, pend);
+        node_ptr result = typename factory_type::mdd_set_union(m_factory)(down, right);
+        down->unuse();
+        right->unuse();
+        return result;
+    }
+
+    /*
+     * Version without projection
+     */
+
+    node_ptr prev(node_ptr r, node_ptr s)
     {
         if (r->sentinel())
             return r;
@@ -35,13 +138,13 @@ struct node_factory<Value>::mdd_rel_prev
 
         node_ptr result;
         if (m_factory.m_cache.lookup(cache_rel_prev, r, s, result))
-            return result->use();
+            return result;
 
         node_ptr down = collect(r->down, s);
         if (down != m_factory.empty())
-            result = m_factory.create(r->value, operator()(r->right, s), down);
+            result = m_factory.create(r->value, prev(r->right, s), down);
         else
-            result = operator()(r->right, s);
+            result = prev(r->right, s);
 
         m_factory.m_cache.store(cache_rel_prev, r, s, result);
         return result;
@@ -60,7 +163,7 @@ struct node_factory<Value>::mdd_rel_prev
         if (r->value > s->value)
             return collect(r, s->right);
 
-        node_ptr down = operator()(r->down, s->down);
+        node_ptr down = prev(r->down, s->down);
         node_ptr right = collect(r->right, s->right);
         node_ptr result = typename factory_type::mdd_set_union(m_factory)(down, right);
         down->unuse();
@@ -0,0 +1,183 @@
+#ifndef __scranen_mdd_operations_rel_saturate_h
+#define __scranen_mdd_operations_rel_saturate_h
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "node_factory.h"
+#include "projection.h"
+#include "rel_next.h"
+#include "set_union.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Computes the states reachable from a set with a partitioned relation, using
+ *        saturation (Ciardo, Marmorstein and Siminiceanu).
+ *
+ * Every partition is an interleaved relation over the levels of its projection, and is
+ * fired at the topmost level of that projection. A sibling list at level k is saturated by
+ * first saturating the lists below it, and then firing the partitions whose top level is k
+ * until nothing changes. New lists created below level k by such a firing are saturated
+ * before they are merged. Since the union of sets that are closed under a relation is
+ * closed as well, the result is closed under all partitions with a top level of k or
+ * more. The fixpoint is thereby computed bottom-up, which keeps intermediate MDDs close to
+ * the final result instead of growing a breadth-first frontier.
+ *
+ * All vectors must have the same length. Saturated lists are stored in the operation
+ * cache, under a token that identifies the set of partitions and the level of the list.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_rel_saturate
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef typename factory_type::cache_type cache_type;
+    typedef typename cache_type::key_type key_type;
+
+    /**
+     * @brief A partition of the relation, which applies to the levels in \p proj, or to all
+     *        levels if \p proj is null. It is fired at level \p top.
+     */
+    struct partition
+    {
+        node_ptr relation;
+        const projection* proj;
+        size_t top;
+    };
+
+    factory_type& m_factory;
+    const std::vector<partition>* m_partitions;
+    key_type m_token;
+
+    static const key_type key_limit = key_type(1) << 32;
+
+    mdd_rel_saturate(factory_type& factory)
+        : m_factory(factory), m_partitions(nullptr), m_token(0)
+    { }
+
+    /**
+     * @brief Returns a partition for \p relation restricted to \p proj (if not null),
+     *        which must outlive it.
+     */
+    static partition make_partition(node_ptr relation, const projection* proj)
+    {
+        partition result = { relation, proj, 0 };
+        if (!proj || proj->full() || proj->size() == 0)
+        {
+            result.proj = nullptr;
+            return result;
+        }
+        for (projection::iterator it = proj->begin(); !*it; ++it)
+            ++result.top;
+        return result;
+    }
+
+    /**
+     * @brief Returns a token that has not been returned before, to identify a set of
+     *        partitions in the operation cache.
+     * @throw std::overflow_error if all 2^32 - 1 tokens have been handed out.
+     */
+    static key_type new_token()
+    {
+        static std::atomic<key_type> next(0);
+        key_type token = ++next;
+        if (token >= key_limit)
+            throw std::overflow_error("Out of saturation cache tokens.");
+        return token;
+    }
+
+    /**
+     * @brief Returns the cache key of the lists at \p level for the set of partitions
+     *        identified by \p token.
+     * @throw std::overflow_error if \p token or \p level does not fit in 32 bits, as the
+     *        key would then collide with that of another list.
+     */
+    static key_type key(key_type token, size_t level)
+    {
+        if (token >= key_limit || level >= key_limit)
+            throw std::overflow_error("Saturation cache key out of range.");
+        return token << 32 | level;
+    }
+
+    /**
+     * @brief Returns the states reachable from \p s with \p partitions, which must be
+     *        sorted by their top level.
+     */
+    node_ptr operator()(node_ptr s, const std::vector<partition>& partitions, key_type token)
+    {
+        m_partitions = &partitions;
+        m_token = token;
+        return saturate(s, 0);
+    }
+private:
+    node_ptr saturate(node_ptr s, size_t level)
+    {
+        if (s->sentinel())
+            return s;
+
+        node_ptr result;
+        if (m_factory.m_cache.lookup(cache_rel_saturate, s, nullptr, nullptr, nullptr, key(m_token, level), result))
+            return result;
+
+        result = saturate_children(s, level);
+        auto first = m_partitions->begin();
+        while (first != m_partitions->end() && first->top < level)
+            ++first;
+        auto last = first;
+        while (last != m_partitions->end() && last->top == level)
+            ++last;
+        if (first != last)
+        {
+            node_ptr old;
+            do
+            {
+                old = result->use();
+                for (auto it = first; it != last; ++it)
+                    result = fire(*it, result, level);
+                old->unuse();
+            }
+            while (old != result);
+        }
+
+        m_factory.m_cache.store(cache_rel_saturate, s, nullptr, nullptr, nullptr, key(m_token, level), result);
+        return result;
+    }
+
+    node_ptr saturate_children(node_ptr s, size_t level)
+    {
+        if (s->sentinel())
+            return s;
+        return m_factory.create(s->value, saturate_children(s->right, level), saturate(s->down, level + 1));
+    }
+
+    /*
+     * Adds the image of s under p to s, and returns the result. Takes ownership of s.
+     */
+    node_ptr fire(const partition& p, node_ptr s, size_t level)
+    {
+        typename factory_type::mdd_rel_next next(m_factory);
+        node_ptr image;
+        if (p.proj)
+        {
+            projection::iterator begin = p.proj->begin();
+            for (size_t i = 0; i < level; ++i)
+                ++begin;
+            image = next(p.relation, s, begin, p.proj->end());
+        }
+        else
+            image = next(p.relation, s);
+        node_ptr saturated = saturate_children(image, level);
+        image->unuse();
+        node_ptr result = typename factory_type::mdd_set_union(m_factory)(s, saturated);
+        s->unuse();
+        saturated->unuse();
+        return result;
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_rel_saturate_h
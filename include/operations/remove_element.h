@@ -0,0 +1,53 @@
+#ifndef __scranen_mdd_operations_remove_element_h
+#define __scranen_mdd_operations_remove_element_h
+
+#include "node_factory.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Removes a vector from an MDD.
+ *
+ * Only the nodes on the path to the removed vector are rebuilt; every subtree that does
+ * not contain it is shared with the original MDD.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_remove_element
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+
+    factory_type& m_factory;
+
+    mdd_remove_element(factory_type& factory)
+        : m_factory(factory)
+    { }
+
+    /**
+     * @brief Removes the vector [\p begin, \p end) from \p a.
+     */
+    template <typename iterator>
+    node_ptr operator()(node_ptr a, const iterator& begin, const iterator& end)
+    {
+        if (a->sentinel())
+        {
+            if (begin == end && a == m_factory.emptylist())
+                return m_factory.empty();
+            return a;
+        }
+        if (begin != end && *begin < a->value)
+            return a->use();
+        if (begin != end && a->value == *begin)
+        {
+            iterator next(begin);
+            node_ptr down = operator()(a->down, ++next, end);
+            return m_factory.rebuild(a, a->right->use(), down);
+        }
+        return m_factory.rebuild(a, operator()(a->right, begin, end), a->down->use());
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_remove_element_h
@@ -0,0 +1,95 @@
+#ifndef __scranen_mdd_operations_remove_sorted_h
+#define __scranen_mdd_operations_remove_sorted_h
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "node_factory.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Removes a sorted batch of vectors from an MDD.
+ *
+ * The vectors are followed through the MDD in a single traversal, so that a prefix shared
+ * by several vectors is visited only once. As with mdd_remove_element, only the nodes on
+ * the paths to removed vectors are rebuilt.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_remove_sorted
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+
+    factory_type& m_factory;
+
+    mdd_remove_sorted(factory_type& factory)
+        : m_factory(factory)
+    { }
+
+    /**
+     * @brief Removes all vectors in [\p begin, \p end) from \p a.
+     * @param begin Iterator to the first vector. Vectors can be of any type that has
+     *        begin() and end() methods.
+     * @param end Iterator past the last vector.
+     * @throw std::runtime_error if the vectors are not sorted lexicographically.
+     */
+    template <typename iterator>
+    node_ptr operator()(node_ptr a, const iterator& begin, const iterator& end)
+    {
+        typedef decltype(begin->begin()) value_iterator;
+        std::vector<std::pair<value_iterator, value_iterator> > cursors;
+        for (iterator it = begin; it != end; ++it)
+        {
+            if (!cursors.empty() && std::lexicographical_compare(it->begin(), it->end(),
+                                                                 cursors.back().first, cursors.back().second))
+                throw std::runtime_error("Input of remove_all() is not sorted.");
+            cursors.push_back(std::make_pair(it->begin(), it->end()));
+        }
+        return remove_all(a, cursors.begin(), cursors.end());
+    }
+private:
+    /*
+     * All cursors in [first, last) point to the same depth of their vectors, and the
+     * vectors share the prefix that leads to the sibling list a. A vector that ends at this
+     * depth sorts before all others, so they are found at the front of the range.
+     */
+    template <typename cursor>
+    node_ptr remove_all(node_ptr a, cursor first, cursor last)
+    {
+        bool terminal = false;
+        while (first != last && first->first == first->second)
+        {
+            terminal = true;
+            ++first;
+        }
+        return remove_siblings(a, first, last, terminal);
+    }
+
+    template <typename cursor>
+    node_ptr remove_siblings(node_ptr a, cursor first, cursor last, bool terminal)
+    {
+        if (a->sentinel())
+        {
+            if (terminal && a == m_factory.emptylist())
+                return m_factory.empty();
+            return a;
+        }
+        while (first != last && *first->first < a->value)
+            ++first;
+        if (first == last && !terminal)
+            return a->use();
+        cursor mid = first;
+        for (; mid != last && *mid->first == a->value; ++mid)
+            ++mid->first;
+        node_ptr down = first == mid ? a->down->use() : remove_all(a->down, first, mid);
+        return m_factory.rebuild(a, remove_siblings(a->right, mid, last, terminal), down);
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_remove_sorted_h
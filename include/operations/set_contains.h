@@ -32,7 +32,7 @@ struct node_factory<Value>::mdd_set_contains
         }
         while (!p->sentinel() && p->value < *begin)
             p = p->right;
-        if (p->value == *begin)
+        if (!p->sentinel() && p->value == *begin)
             return operator()(p->down, begin + 1, end);
         return false;
     }
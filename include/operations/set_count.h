@@ -1,76 +1,194 @@
 #ifndef __scranen_mdd_operations_set_count_h
 #define __scranen_mdd_operations_set_count_h
 
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "node_factory.h"
 #include "add_element.h"
 
 namespace mdd
 {
 
+/**
+ * @brief Counts the vectors in an MDD.
+ *
+ * The number of paths below every node is computed once, so the time taken is linear in the
+ * number of nodes, regardless of how much they are shared. The siblings of a list are added
+ * up in a loop, so the recursion is only as deep as the number of levels. Nodes are never
+ * modified, so MDDs can be counted by several threads at once.
+ *
+ * Exact counts are also memoized by the factory, in a bounded memo that is split into
+ * shards with their own lock. They remain valid until nodes are removed by
+ * node_factory::clean(). Counting an MDD that was built from a recently counted one
+ * therefore usually only visits the new nodes. A full shard evicts an entry for every new
+ * one, so the counts that a counter has seen are also kept by the counter itself: repeated
+ * calls on the same object, such as the steps of mdd_set_rank, never count a node twice,
+ * however many entries other threads evict from the factory's memo.
+ */
 template <typename Value>
 struct node_factory<Value>::mdd_set_count
 {
     typedef node_factory<Value> factory_type;
     typedef typename factory_type::node_ptr node_ptr;
+    typedef typename factory_type::count_shard count_shard;
 
     factory_type& m_factory;
+    std::unordered_map<node_ptr, path_count> m_counts;
 
     mdd_set_count(factory_type& factory)
         : m_factory(factory)
     { }
 
+    /**
+     * @brief Returns the number of vectors in \p p. If that number does not fit in a
+     *        path_count, the largest path_count is returned.
+     */
+    path_count exact(node_ptr p)
+    {
+        std::vector<node_ptr> counted;
+        path_count result = count(p, m_counts, &counted);
+        remember(counted);
+        return result;
+    }
+
     double operator()(node_ptr p)
     {
-        size_t nodes = 0;
+        path_count result = exact(p);
+        if (result != std::numeric_limits<path_count>::max())
+            return result;
+        size_t nodes;
         return operator()(p, nodes);
     }
 
+    /**
+     * @brief Returns the number of vectors in \p p, and sets \p nodes to the number of
+     *        distinct nodes (including the terminal nodes) reachable from \p p.
+     */
     double operator()(node_ptr p, size_t& nodes)
     {
-        double result = 0;
-        const_cast<typename factory_type::node_type*>(m_factory.empty())->right = nullptr;
-        const_cast<typename factory_type::node_type*>(m_factory.emptylist())->right = nullptr;
-        count(p, result, nodes);
-        clean(p);
+        std::unordered_map<node_ptr, double> counts;
+        double result = count(p, counts, nullptr);
+        nodes = counts.size();
         return result;
     }
 private:
-    void count(node_ptr p, double& paths, size_t& nodes)
+    static path_count add(path_count a, path_count b)
+    {
+        path_count sum = a + b;
+        return sum < a ? std::numeric_limits<path_count>::max() : sum;
+    }
+
+    static double add(double a, double b)
+    {
+        return a + b;
+    }
+
+    count_shard& shard(node_ptr p)
+    {
+        return m_factory.m_counts[std::hash<node_ptr>()(p) % factory_type::count_shards];
+    }
+
+    // Must be called with the lock of the shard held.
+    void synchronize(count_shard& s)
     {
-        if (p == m_factory.emptylist())
+        size_t generation = m_factory.m_generation;
+        if (s.generation != generation)
         {
-            paths += 1;
+            s.counts.clear();
+            s.generation = generation;
         }
-        if (!((size_t)p->right & 1))
+    }
+
+    bool recall(node_ptr p, path_count& result)
+    {
+        count_shard& s = shard(p);
+        utilities::lock_guard lock(s.mutex);
+        synchronize(s);
+        auto it = s.counts.find(p);
+        if (it == s.counts.end())
+            return false;
+        result = it->second;
+        return true;
+    }
+
+    // Approximate counts are not memoized, so that the number of nodes can be reported.
+    bool recall(node_ptr, double&)
+    {
+        return false;
+    }
+
+    /*
+     * Adds the counts of the nodes that were counted to the memo of the factory, taking the
+     * lock of every shard once. A shard that is full evicts an arbitrary entry for every
+     * new one.
+     */
+    void remember(const std::vector<node_ptr>& counted)
+    {
+        std::vector<std::pair<node_ptr, path_count> > batches[factory_type::count_shards];
+        for (node_ptr p: counted)
+            batches[&shard(p) - m_factory.m_counts].push_back(std::make_pair(p, m_counts[p]));
+        for (size_t i = 0; i < factory_type::count_shards; ++i)
         {
-            node_ptr right = p->right;
-            const_cast<typename factory_type::node_type*&>(p)->right = (node_ptr)((uintptr_t)right | 1);
-            ++nodes;
-            if (!p->sentinel())
+            if (batches[i].empty())
+                continue;
+            count_shard& s = m_factory.m_counts[i];
+            utilities::lock_guard lock(s.mutex);
+            synchronize(s);
+            for (auto& entry: batches[i])
             {
-                count(right, paths, nodes);
-                count(p->down, paths, nodes);
+                if (s.counts.count(entry.first))
+                    continue;
+                if (s.counts.size() >= factory_type::count_shard_limit)
+                    s.counts.erase(s.counts.begin());
+                s.counts.insert(entry);
             }
         }
-        else
+    }
+
+    /*
+     * Walks along the siblings of p up to the first one with a known count, and then adds
+     * the counts of the levels below them from right to left. Nodes whose count was computed
+     * rather than found are added to counted, if given.
+     */
+    template <typename count_type>
+    count_type count(node_ptr p, std::unordered_map<node_ptr, count_type>& counts, std::vector<node_ptr>* counted)
+    {
+        std::vector<node_ptr> siblings;
+        count_type result;
+        for (;; p = p->right)
         {
-            if (!p->sentinel())
+            auto it = counts.find(p);
+            if (it != counts.end())
+            {
+                result = it->second;
+                break;
+            }
+            if (p->sentinel())
+            {
+                result = p == m_factory.emptylist() ? 1 : 0;
+                counts[p] = result;
+                break;
+            }
+            if (recall(p, result))
             {
-                count((node_ptr)((uintptr_t)p->right ^ 1), paths, nodes);
-                count(p->down, paths, nodes);
+                counts[p] = result;
+                break;
             }
+            siblings.push_back(p);
         }
-    }
-
-    void clean(node_ptr p)
-    {
-        if (!((uintptr_t)p->right & 1))
-            return;
-        const_cast<typename factory_type::node_type*&>(p)->right = (node_ptr)((uintptr_t)p->right ^ 1);
-        if (p->sentinel())
-            return;
-        clean(p->right);
-        clean(p->down);
+        while (!siblings.empty())
+        {
+            p = siblings.back();
+            siblings.pop_back();
+            result = add(result, count(p->down, counts, counted));
+            counts[p] = result;
+            if (counted)
+                counted->push_back(p);
+        }
+        return result;
     }
 };
 
@@ -0,0 +1,176 @@
+#ifndef __scranen_mdd_operations_set_export_h
+#define __scranen_mdd_operations_set_export_h
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "node_factory.h"
+#include "set_count.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Order in which mdd::export_columns() writes the vectors of an MDD.
+ */
+enum export_layout
+{
+    export_row_major,   ///< The vectors are written one after the other.
+    export_column_major ///< The first elements of all vectors are written first, and so on.
+};
+
+/**
+ * @brief Writes the vectors of an MDD into a flat array, with one row per vector.
+ *
+ * All vectors must have the same length. They are written in the order of mdd_iterator. To
+ * write in parallel, the MDD is split into subtrees until there are enough of them to keep
+ * all threads busy. The row at which each subtree starts follows from the number of vectors
+ * in the subtrees before it, so that threads write disjoint rows without synchronising.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_set_export
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+
+    struct task
+    {
+        node_ptr list;
+        size_t row;
+        std::vector<Value> prefix;
+    };
+
+    factory_type& m_factory;
+    Value* m_out;
+    size_t m_rows;
+    size_t m_depth;
+    export_layout m_layout;
+    std::atomic<bool> m_ragged;
+
+    mdd_set_export(factory_type& factory)
+        : m_factory(factory), m_out(nullptr), m_rows(0), m_depth(0), m_layout(export_row_major), m_ragged(false)
+    { }
+
+    /**
+     * @brief Writes the vectors in \p p to \p out, using \p threads threads.
+     * @return The number of vectors written.
+     * @throw std::length_error if \p out cannot hold all vectors.
+     * @throw std::runtime_error if not all vectors have the same length.
+     */
+    size_t operator()(node_ptr p, Value* out, size_t capacity, export_layout layout, unsigned threads)
+    {
+        typename factory_type::mdd_set_count count(m_factory);
+        path_count rows = count.exact(p);
+        if (rows == 0)
+            return 0;
+        m_depth = 0;
+        for (node_ptr q = p; !q->sentinel(); q = q->down)
+            ++m_depth;
+        if (rows > std::numeric_limits<size_t>::max() / (m_depth ? m_depth : 1) || rows * m_depth > capacity)
+            throw std::length_error("MDD does not fit in the export buffer.");
+        m_out = out;
+        m_rows = (size_t)rows;
+        m_layout = layout;
+        m_ragged = false;
+
+        std::vector<task> tasks(1);
+        tasks[0].list = p;
+        tasks[0].row = 0;
+        if (threads > 1)
+            split(tasks, threads * 8, count);
+        if (threads > tasks.size())
+            threads = tasks.size();
+        if (threads <= 1)
+        {
+            for (auto it = tasks.begin(); it != tasks.end(); ++it)
+                run(*it);
+        }
+        else
+        {
+            std::atomic<size_t> next(0);
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; ++t)
+                workers.push_back(std::thread([&]() {
+                    for (size_t i = next++; i < tasks.size(); i = next++)
+                        run(tasks[i]);
+                }));
+            for (auto it = workers.begin(); it != workers.end(); ++it)
+                it->join();
+        }
+        if (m_ragged)
+            throw std::runtime_error("Cannot export an MDD with vectors of different lengths.");
+        return m_rows;
+    }
+private:
+    /*
+     * Replaces tasks by the subtrees of their sibling lists, until there are at least
+     * target tasks or the tasks have reached the bottom of the MDD.
+     */
+    void split(std::vector<task>& tasks, size_t target, typename factory_type::mdd_set_count& count)
+    {
+        for (size_t level = 0; level < m_depth && tasks.size() < target; ++level)
+        {
+            std::vector<task> next;
+            for (auto it = tasks.begin(); it != tasks.end(); ++it)
+            {
+                size_t row = it->row;
+                node_ptr p = it->list;
+                for (; !p->sentinel(); p = p->right)
+                {
+                    task t;
+                    t.list = p->down;
+                    t.row = row;
+                    t.prefix = it->prefix;
+                    t.prefix.push_back(p->value);
+                    next.push_back(t);
+                    row += (size_t)count.exact(p->down);
+                }
+                if (p != m_factory.empty())
+                    m_ragged = true;
+            }
+            tasks.swap(next);
+        }
+    }
+
+    void run(task& t)
+    {
+        std::vector<Value> path(t.prefix);
+        path.reserve(m_depth);
+        size_t row = t.row;
+        write(t.list, path, row);
+    }
+
+    void write(node_ptr p, std::vector<Value>& path, size_t& row)
+    {
+        if (path.size() == m_depth)
+        {
+            if (p != m_factory.emptylist())
+                m_ragged = true;
+            else if (m_layout == export_row_major)
+                std::copy(path.begin(), path.end(), m_out + row++ * m_depth);
+            else
+            {
+                for (size_t i = 0; i < m_depth; ++i)
+                    m_out[i * m_rows + row] = path[i];
+                ++row;
+            }
+            return;
+        }
+        for (; !p->sentinel(); p = p->right)
+        {
+            path.push_back(p->value);
+            write(p->down, path, row);
+            path.pop_back();
+        }
+        if (p != m_factory.empty())
+            m_ragged = true;
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_set_export_h
@@ -0,0 +1,81 @@
+#ifndef __scranen_mdd_operations_set_for_each_h
+#define __scranen_mdd_operations_set_for_each_h
+
+#include <vector>
+
+#include "node_factory.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Tells mdd::for_each() how to continue after a prefix has been visited.
+ */
+enum visit_action
+{
+    visit_continue, ///< Visit the vectors that start with the prefix.
+    visit_skip,     ///< Skip the vectors that start with the prefix.
+    visit_stop      ///< End the enumeration.
+};
+
+/**
+ * @brief Enumerates the vectors in an MDD by calling back for each of them.
+ *
+ * The current vector is kept in a single buffer that grows with the depth of the MDD, so
+ * that after the first few vectors, the enumeration does not allocate any memory. Vectors
+ * are visited in the same order as with mdd_iterator.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_set_for_each
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef std::vector<Value> vector_type;
+
+    struct visit_all
+    {
+        visit_action operator()(const vector_type&) const { return visit_continue; }
+    };
+
+    factory_type& m_factory;
+    vector_type m_path;
+
+    mdd_set_for_each(factory_type& factory)
+        : m_factory(factory)
+    {
+        m_path.reserve(64);
+    }
+
+    /**
+     * @brief Calls \p element for every vector in \p p, until it returns false. Before
+     *        the vectors starting with a prefix are visited, \p prefix is called with that
+     *        prefix, and may skip them or end the enumeration.
+     * @return False if the enumeration was ended by one of the callbacks, true otherwise.
+     */
+    template <typename ElementCallback, typename PrefixCallback>
+    bool operator()(node_ptr p, ElementCallback& element, PrefixCallback& prefix)
+    {
+        m_path.clear();
+        return visit(p, element, prefix);
+    }
+private:
+    template <typename ElementCallback, typename PrefixCallback>
+    bool visit(node_ptr p, ElementCallback& element, PrefixCallback& prefix)
+    {
+        for (; !p->sentinel(); p = p->right)
+        {
+            m_path.push_back(p->value);
+            visit_action action = prefix(static_cast<const vector_type&>(m_path));
+            if (action == visit_stop)
+                return false;
+            if (action == visit_continue && !visit(p->down, element, prefix))
+                return false;
+            m_path.pop_back();
+        }
+        return p != m_factory.emptylist() || element(static_cast<const vector_type&>(m_path));
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_set_for_each_h
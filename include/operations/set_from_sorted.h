@@ -0,0 +1,136 @@
+#ifndef __scranen_mdd_operations_set_from_sorted_h
+#define __scranen_mdd_operations_set_from_sorted_h
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "node_factory.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Builds an MDD from a lexicographically sorted range of vectors in a single pass.
+ *
+ * For every level of the vector that is currently being read, the children that have been
+ * completed so far are kept in a pending list, together with a flag that records whether
+ * the vector ending at that level is in the set. When the next vector leaves a prefix, the
+ * levels below that prefix are complete, and their sibling lists are created from right to
+ * left. Every node of the result is therefore created exactly once, and no intermediate
+ * MDDs are built. Duplicate vectors are ignored.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_set_from_sorted
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+
+    struct level
+    {
+        std::vector<std::pair<Value, node_ptr> > children;
+        bool terminal;
+    };
+
+    factory_type& m_factory;
+    std::vector<level> m_levels;
+    std::vector<Value> m_path;
+
+    mdd_set_from_sorted(factory_type& factory)
+        : m_factory(factory)
+    { }
+
+    /**
+     * @brief Builds the MDD containing the vectors in [\p begin, \p end).
+     * @throw std::runtime_error if the input is not sorted.
+     */
+    template <typename iterator>
+    node_ptr operator()(iterator begin, iterator end)
+    {
+        m_path.clear();
+        m_levels.resize(1);
+        m_levels[0].children.clear();
+        m_levels[0].terminal = false;
+        bool first = true;
+        for (; begin != end; ++begin)
+        {
+            if (!push(begin->begin(), begin->end(), first))
+            {
+                release();
+                throw std::runtime_error("Input of from_sorted() is not sorted.");
+            }
+            first = false;
+        }
+        close(0);
+        return finish(0);
+    }
+private:
+    template <typename value_iterator>
+    bool push(value_iterator vbegin, value_iterator vend, bool first)
+    {
+        // Find the length of the common prefix with the previous vector.
+        size_t prefix = 0;
+        while (prefix < m_path.size() && vbegin != vend && *vbegin == m_path[prefix])
+        {
+            ++prefix;
+            ++vbegin;
+        }
+        if (!first)
+        {
+            if (vbegin == vend)
+                return prefix == m_path.size(); // duplicate, or a prefix of the previous vector
+            if (prefix < m_path.size() && !(m_path[prefix] < *vbegin))
+                return false;
+        }
+        close(prefix);
+        for (; vbegin != vend; ++vbegin)
+        {
+            m_path.push_back(*vbegin);
+            if (m_levels.size() <= m_path.size())
+                m_levels.resize(m_path.size() + 1);
+            level& l = m_levels[m_path.size()];
+            l.children.clear();
+            l.terminal = false;
+        }
+        m_levels[m_path.size()].terminal = true;
+        return true;
+    }
+
+    /*
+     * Completes all levels below depth, and adds them to their parents.
+     */
+    void close(size_t depth)
+    {
+        while (m_path.size() > depth)
+        {
+            node_ptr child = finish(m_path.size());
+            Value value = m_path.back();
+            m_path.pop_back();
+            m_levels[m_path.size()].children.push_back(std::make_pair(value, child));
+        }
+    }
+
+    node_ptr finish(size_t depth)
+    {
+        level& l = m_levels[depth];
+        node_ptr result = l.terminal ? m_factory.emptylist() : m_factory.empty();
+        for (auto it = l.children.rbegin(); it != l.children.rend(); ++it)
+            result = m_factory.create(it->first, result, it->second);
+        l.children.clear();
+        return result;
+    }
+
+    void release()
+    {
+        for (size_t depth = 0; depth <= m_path.size(); ++depth)
+        {
+            for (auto it = m_levels[depth].children.begin(); it != m_levels[depth].children.end(); ++it)
+                it->second->unuse();
+            m_levels[depth].children.clear();
+        }
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_set_from_sorted_h
@@ -36,7 +36,7 @@ struct node_factory<Value>::mdd_set_intersect
             return operator()(a->right, b);
 
         if (m_factory.m_cache.lookup(cache_set_intersection, a, b, result))
-            return result->use();
+            return result;
 
         if (a->value == b->value)
             result = m_factory.create(a->value, operator()(a->right, b->right), operator()(a->down, b->down));
@@ -36,7 +36,7 @@ struct node_factory<Value>::mdd_set_minus
 
         node_ptr result;
         if (m_factory.m_cache.lookup(cache_set_minus, a, b, result))
-            return result->use();
+            return result;
 
         if (a->sentinel() || a->value > b->value)
             result = operator()(a, b->right);
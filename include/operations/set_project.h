@@ -34,7 +34,7 @@ private:
 
         node_ptr result;
         if (m_factory.m_cache.lookup(cache_set_project, p, nullptr, begin.node(), result))
-            return result->use();
+            return result;
 
         if (*begin)
         {
@@ -0,0 +1,89 @@
+#ifndef __scranen_mdd_operations_set_rank_h
+#define __scranen_mdd_operations_set_rank_h
+
+#include <stdexcept>
+#include <vector>
+
+#include "node_factory.h"
+#include "set_count.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Maps between vectors in an MDD and their positions.
+ *
+ * Positions follow the order of mdd_iterator: vectors are ordered lexicographically, except
+ * that a vector comes after the vectors it is a proper prefix of. For sets of vectors of
+ * equal length, this is plain lexicographic order.
+ *
+ * Both directions descend a single path, and skip the siblings on that path by subtracting
+ * or adding their memoized number of vectors (see mdd_set_count), so they take time linear
+ * in the length of the vector and the size of the sibling lists on its path.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_set_rank
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef std::vector<Value> vector_type;
+
+    factory_type& m_factory;
+    typename factory_type::mdd_set_count m_count;
+
+    mdd_set_rank(factory_type& factory)
+        : m_factory(factory), m_count(factory)
+    { }
+
+    /**
+     * @brief Returns the vector at position \p index in \p p.
+     * @throw std::out_of_range if \p p contains no more than \p index vectors.
+     */
+    vector_type at(node_ptr p, path_count index)
+    {
+        if (index >= m_count.exact(p))
+            throw std::out_of_range("MDD index out of range.");
+        vector_type result;
+        while (p != m_factory.emptylist())
+        {
+            path_count below = m_count.exact(p->down);
+            if (index < below)
+            {
+                result.push_back(p->value);
+                p = p->down;
+            }
+            else
+            {
+                index -= below;
+                p = p->right;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Returns the number of vectors in \p p that come before [\p begin, \p end).
+     *        If the vector is in \p p, this is its position.
+     */
+    template <typename iterator>
+    path_count rank(node_ptr p, iterator begin, const iterator& end)
+    {
+        path_count result = 0;
+        for (; begin != end; ++begin)
+        {
+            for (; !p->sentinel() && p->value < *begin; p = p->right)
+                result += m_count.exact(p->down);
+            if (p->sentinel() || !(p->value == *begin))
+                return result;
+            p = p->down;
+        }
+        // All extensions of the vector come before it.
+        for (; !p->sentinel(); p = p->right)
+            result += m_count.exact(p->down);
+        return result;
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_set_rank_h
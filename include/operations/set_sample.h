@@ -0,0 +1,88 @@
+#ifndef __scranen_mdd_operations_set_sample_h
+#define __scranen_mdd_operations_set_sample_h
+
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "node_factory.h"
+#include "set_count.h"
+#include "set_rank.h"
+
+namespace mdd
+{
+
+/**
+ * @brief Draws vectors uniformly at random from an MDD.
+ *
+ * A sample is drawn by picking a random position below the number of vectors in the MDD,
+ * and looking up the vector at that position with mdd_set_rank::at(). Every vector is
+ * therefore equally likely, and the MDD is never enumerated.
+ */
+template <typename Value>
+struct node_factory<Value>::mdd_set_sample
+{
+    typedef node_factory<Value> factory_type;
+    typedef typename factory_type::node_ptr node_ptr;
+    typedef std::vector<Value> vector_type;
+
+    factory_type& m_factory;
+
+    mdd_set_sample(factory_type& factory)
+        : m_factory(factory)
+    { }
+
+    /**
+     * @brief Draws \p k vectors from \p p, with replacement.
+     * @throw std::runtime_error if \p p is empty.
+     * @throw std::overflow_error if the number of vectors in \p p does not fit in a
+     *        path_count.
+     */
+    template <typename Rng>
+    std::vector<vector_type> operator()(node_ptr p, Rng& rng, size_t k)
+    {
+        typename factory_type::mdd_set_rank rank(m_factory);
+        path_count total = rank.m_count.exact(p);
+        if (total == 0)
+            throw std::runtime_error("Cannot sample from an empty MDD.");
+        if (total == std::numeric_limits<path_count>::max())
+            throw std::overflow_error("MDD is too large to sample from.");
+        std::vector<vector_type> result;
+        result.reserve(k);
+        for (size_t i = 0; i < k; ++i)
+            result.push_back(rank.at(p, random(rng, total)));
+        return result;
+    }
+private:
+    /*
+     * Returns a uniformly distributed number in [0, bound), by drawing numbers with as many
+     * bits as bound - 1 until one is below bound.
+     */
+    template <typename Rng>
+    static path_count random(Rng& rng, path_count bound)
+    {
+        typedef unsigned long long word;
+        const int word_bits = std::numeric_limits<word>::digits;
+        path_count max = bound - 1;
+        if (max <= std::numeric_limits<word>::max())
+            return std::uniform_int_distribution<word>(0, (word)max)(rng);
+        int bits = 0;
+        for (path_count m = max; m; m >>= 1)
+            ++bits;
+        std::uniform_int_distribution<word> draw;
+        path_count result;
+        do
+        {
+            result = 0;
+            for (int b = 0; b < bits; b += word_bits)
+                result = (result << (word_bits - 1) << 1) | draw(rng);
+            result &= (path_count(1) << (bits - 1) << 1) - 1;
+        } while (result > max);
+        return result;
+    }
+};
+
+}
+
+#endif // __scranen_mdd_operations_set_sample_h
@@ -36,7 +36,7 @@ struct node_factory<Value>::mdd_set_union
             return add_element(m_factory)(a);
 
         if (m_factory.m_cache.lookup(cache_set_union, a, b, result))
-            return result->use();
+            return result;
 
         if (a->value < b->value)
             result = m_factory.create(a->value, operator()(a->right, b), a->down->use());
@@ -68,7 +68,7 @@ public:
     }
 
     projection(const projection& other)
-        : m_factory(other.m_factory), m_node(other.m_node)
+        : m_factory(other.m_factory), m_node(other.m_node), m_size(other.m_size), m_domain_size(other.m_domain_size)
     { }
 private:
     factory_type& m_factory;
@@ -0,0 +1,208 @@
+#ifndef __scranen_mdd_unique_table_h
+#define __scranen_mdd_unique_table_h
+
+#include <assert.h>
+#include <stddef.h>
+#include <iterator>
+
+namespace mdd
+{
+
+/**
+ * @brief Hash table that guarantees the uniqueness of MDD nodes.
+ *
+ * This is an open-addressing table with linear probing that stores each node pointer
+ * together with its hash value. Lookups compare the cached hash before touching the node
+ * itself, and the table can be probed with a (value, right, down) triple so that a node
+ * only needs to be allocated when it does not exist yet. Erasing uses backward shift
+ * deletion, so the table never contains tombstones.
+ */
+template <typename Node>
+class unique_table
+{
+public:
+    typedef size_t size_type;
+    typedef typename Node::value_type value_type;
+    typedef const Node* node_ptr;
+    typedef typename Node::hash hash_type;
+private:
+    struct entry
+    {
+        size_t hash;
+        node_ptr node;
+    };
+public:
+    class iterator : public std::iterator<std::forward_iterator_tag, node_ptr>
+    {
+        friend class unique_table;
+    private:
+        const entry* m_pos;
+        const entry* m_end;
+
+        iterator(const entry* pos, const entry* end)
+            : m_pos(pos), m_end(end)
+        {
+            skip();
+        }
+
+        void skip()
+        {
+            while (m_pos != m_end && !m_pos->node)
+                ++m_pos;
+        }
+    public:
+        node_ptr operator*() const { return m_pos->node; }
+        iterator& operator++() { ++m_pos; skip(); return *this; }
+        iterator operator++(int) { iterator it(*this); operator++(); return it; }
+        bool operator==(const iterator& other) const { return m_pos == other.m_pos; }
+        bool operator!=(const iterator& other) const { return m_pos != other.m_pos; }
+    };
+
+    /**
+     * @brief Constructor.
+     * @param capacity The initial number of slots. Must be a power of two.
+     */
+    unique_table(size_type capacity = 1024)
+        : m_entries(new entry[capacity]()), m_capacity(capacity), m_size(0)
+    { }
+
+    unique_table(const unique_table&) = delete;
+    unique_table& operator=(const unique_table&) = delete;
+
+    ~unique_table()
+    {
+        delete[] m_entries;
+    }
+
+    iterator begin() const { return iterator(m_entries, m_entries + m_capacity); }
+    iterator end() const { return iterator(m_entries + m_capacity, m_entries + m_capacity); }
+
+    size_type size() const { return m_size; }
+
+    /**
+     * @brief Returns true if the table will grow on the next call to find().
+     */
+    bool full() const { return (m_size + 1) * 10 > m_capacity * 7; }
+
+    /**
+     * @brief Returns the number of bytes used by the table itself.
+     */
+    size_type bytes() const { return m_capacity * sizeof(entry); }
+
+    /**
+     * @brief Looks up the node (\p value, \p right, \p down).
+     * @param value The value of the node.
+     * @param right The right pointer of the node.
+     * @param down The down pointer of the node.
+     * @param hash The hash of the node, as computed by Node::hash.
+     * @param slot Set to the slot in which the node should be inserted if it is not found.
+     *        This slot remains valid until the table is modified. If the node is found,
+     *        \p slot is set to an invalid slot.
+     * @return The node in the table, or nullptr if it does not exist.
+     */
+    node_ptr find(const value_type& value, node_ptr right, node_ptr down, size_t hash, size_type& slot)
+    {
+        if (full())
+            resize(m_capacity * 2);
+        slot = m_capacity;
+        size_type mask = m_capacity - 1;
+        size_type i = hash & mask;
+        // The table is grown before it is 70% full, so there is always an empty slot.
+        for (size_type probes = 0; probes < m_capacity; ++probes, i = (i + 1) & mask)
+        {
+            const entry& e = m_entries[i];
+            if (!e.node)
+            {
+                slot = i;
+                return nullptr;
+            }
+            if (e.hash == hash && e.node->right == right && e.node->down == down && e.node->value == value)
+                return e.node;
+        }
+        assert(!"unique_table::find() probed a full table");
+        return nullptr;
+    }
+
+    /**
+     * @brief Inserts \p node into the table.
+     * @param slot The slot returned by the last call to find().
+     * @param hash The hash value that was passed to find().
+     * @param node The node to insert.
+     */
+    void insert(size_type slot, size_t hash, node_ptr node)
+    {
+        assert(slot < m_capacity && !m_entries[slot].node);
+        m_entries[slot].hash = hash;
+        m_entries[slot].node = node;
+        ++m_size;
+    }
+
+    /**
+     * @brief Removes the node pointed to by \p it from the table.
+     * @return An iterator to the next node. Nodes that were not yet visited are not skipped,
+     *         but a node that was already visited may be visited again.
+     */
+    iterator erase(iterator it)
+    {
+        erase_slot(it.m_pos - m_entries);
+        return iterator(it.m_pos, it.m_end);
+    }
+
+    /**
+     * @brief Removes \p node from the table.
+     * @param node A node that is in the table.
+     */
+    void erase(node_ptr node)
+    {
+        size_type mask = m_capacity - 1;
+        size_type i = hash_type()(node) & mask;
+        for (size_type probes = 0; m_entries[i].node != node; ++probes)
+        {
+            assert(probes < m_capacity && m_entries[i].node);
+            i = (i + 1) & mask;
+        }
+        erase_slot(i);
+    }
+private:
+    void erase_slot(size_type i)
+    {
+        size_type mask = m_capacity - 1;
+        for (size_type j = (i + 1) & mask; m_entries[j].node; j = (j + 1) & mask)
+        {
+            size_type home = m_entries[j].hash & mask;
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+                continue;
+            m_entries[i] = m_entries[j];
+            i = j;
+        }
+        m_entries[i].node = nullptr;
+        --m_size;
+    }
+
+    void resize(size_type capacity)
+    {
+        entry* old = m_entries;
+        size_type oldcapacity = m_capacity;
+        m_entries = new entry[capacity]();
+        m_capacity = capacity;
+        size_type mask = capacity - 1;
+        for (size_type i = 0; i < oldcapacity; ++i)
+        {
+            if (!old[i].node)
+                continue;
+            size_type j = old[i].hash & mask;
+            while (m_entries[j].node)
+                j = (j + 1) & mask;
+            m_entries[j] = old[i];
+        }
+        delete[] old;
+    }
+
+    entry* m_entries;
+    size_type m_capacity;
+    size_type m_size;
+};
+
+} // namespace mdd
+
+#endif // __scranen_mdd_unique_table_h
@@ -0,0 +1,38 @@
+#ifndef __scranen_mdd_utilities_mutex_h
+#define __scranen_mdd_utilities_mutex_h
+
+#ifdef MDD_THREAD_SAFE
+#include <mutex>
+#endif
+
+namespace mdd
+{
+namespace utilities
+{
+
+#ifdef MDD_THREAD_SAFE
+typedef std::mutex mutex;
+typedef std::lock_guard<std::mutex> lock_guard;
+#else
+/**
+ * @brief Mutex that does nothing. Used in place of std::mutex when the library is not
+ *        compiled with MDD_THREAD_SAFE, so that locking compiles away entirely.
+ */
+class mutex
+{
+public:
+    void lock() { }
+    void unlock() { }
+};
+
+class lock_guard
+{
+public:
+    explicit lock_guard(mutex&) { }
+};
+#endif
+
+} // namespace utilities
+} // namespace mdd
+
+#endif // __scranen_mdd_utilities_mutex_h
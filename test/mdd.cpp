@@ -1,12 +1,24 @@
 // #define DEBUG_MDD_NODES
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <random>
+#include <deque>
+#ifdef MDD_THREAD_SAFE
+#include <thread>
+#endif
 
 #include <gtest/gtest.h>
 
 #include "mdd.h"
+#include "mdd_inserter.h"
+#include "operations/reachability.h"
 #include "utilities/zip.h"
 #include "projection.h"
 
@@ -76,6 +88,624 @@ TEST_F(MDDTest, CreateStringMDD)
     EXPECT_EQ(0, strfactory.size()) << strfactory.print_nodes();
 }
 
+TEST_F(MDDTest, NodeReclamation)
+{
+    mdd::mdd_factory<int> factory;
+    size_t bytes;
+    {
+        mdd::mdd<int> m = factory.empty_set();
+        for (int i = 0; i < 10000; ++i)
+        {
+            int v[3] = { i % 7, i % 13, i };
+            m.add_in_place(v, v + 3);
+        }
+    }
+    factory.clean();
+    EXPECT_EQ(0, factory.size());
+    bytes = factory.node_bytes();
+    EXPECT_LT(0, bytes);
+    {
+        mdd::mdd<int> m = factory.empty_set();
+        for (int i = 0; i < 10000; ++i)
+        {
+            int v[3] = { i % 7, i % 13, i };
+            m.add_in_place(v, v + 3);
+        }
+    }
+    factory.clean();
+    EXPECT_EQ(0, factory.size());
+#ifdef MDD_THREAD_SAFE
+    // Every shard reuses its own memory, but nodes may hash to other shards this time.
+    EXPECT_GT(2 * bytes, factory.node_bytes());
+#else
+    EXPECT_EQ(bytes, factory.node_bytes());
+#endif
+}
+
+TEST_F(MDDTest, FromSorted)
+{
+    mdd::mdd_factory<int> factory;
+    std::vector<std::vector<int> > input = {
+        { }, { 1 }, { 1, 2 }, { 1, 2 }, { 1, 2, 3 }, { 1, 3 }, { 2, 1, 1 }, { 2, 2 }, { 4 }
+    };
+    mdd::mdd<int> expected = factory.empty_set();
+    for (auto& v : input)
+        expected += v;
+    mdd::mdd<int> m = factory.from_sorted(input.begin(), input.end());
+    EXPECT_EQ(expected, m);
+    EXPECT_EQ(8, m.size());
+    EXPECT_EQ(factory.empty_set(), factory.from_sorted(input.begin(), input.begin()));
+
+    std::vector<std::vector<int> > large;
+    for (int i = 0; i < 1000; ++i)
+        large.push_back({ i / 100, i / 10 % 10, i % 7, i });
+    std::sort(large.begin(), large.end());
+    expected = factory.empty_set();
+    for (auto& v : large)
+        expected += v;
+    EXPECT_EQ(expected, factory.from_sorted(large.begin(), large.end()));
+
+    std::swap(input[5], input[6]);
+    EXPECT_THROW(factory.from_sorted(input.begin(), input.end()), std::runtime_error);
+    std::swap(input[1], input[2]);
+    EXPECT_THROW(factory.from_sorted(input.begin(), input.begin() + 3), std::runtime_error);
+}
+
+TEST_F(MDDTest, Remove)
+{
+    mdd::mdd_factory<int> factory;
+    std::vector<std::vector<int> > all;
+    for (int i = 0; i < 500; ++i)
+        all.push_back({ i % 3, i % 7, i % 11, i % 5 });
+    all.push_back({ });
+    all.push_back({ 1 });
+    all.push_back({ 1, 1 });
+    std::sort(all.begin(), all.end());
+    all.erase(std::unique(all.begin(), all.end()), all.end());
+    mdd::mdd<int> m = factory.from_sorted(all.begin(), all.end());
+
+    std::vector<std::vector<int> > removed, kept;
+    for (size_t i = 0; i < all.size(); ++i)
+        (i % 3 == 0 ? removed : kept).push_back(all[i]);
+    removed.push_back({ 9, 9 });  // not in the set
+    std::sort(removed.begin(), removed.end());
+    mdd::mdd<int> expected = factory.from_sorted(kept.begin(), kept.end());
+
+    mdd::mdd<int> single = m;
+    for (auto& v : removed)
+        single.remove_in_place(v.begin(), v.end());
+    EXPECT_EQ(expected, single);
+    EXPECT_EQ(m, m.remove(removed.back().begin(), removed.back().end()));
+    EXPECT_EQ(expected, m.remove_all(removed.begin(), removed.end()));
+    EXPECT_EQ(m, m.remove_all(removed.begin(), removed.begin()));
+    EXPECT_EQ(factory.empty_set(), m.remove_all(all.begin(), all.end()));
+
+    mdd::mdd<int> before = m;
+    std::reverse(removed.begin(), removed.end());
+    EXPECT_THROW(m.remove_all_in_place(removed.begin(), removed.end()), std::runtime_error);
+    EXPECT_EQ(before, m);
+}
+
+TEST_F(MDDTest, Inserter)
+{
+    mdd::mdd_factory<int> factory;
+    mdd::mdd<int> expected = factory.empty_set();
+    mdd::mdd<int> m = factory.empty_set();
+    {
+        mdd::mdd_inserter<int> inserter(m, 100);
+        for (int i = 0; i < 1000; ++i)
+        {
+            std::vector<int> v(i % 5, (i * 7919) % 31);
+            v.push_back(i % 13);
+            expected += v;
+            inserter += v;
+            EXPECT_EQ(size_t((i + 1) % 100), inserter.pending());
+        }
+        std::vector<int> v = { 42 };
+        inserter += v;
+        expected += v;
+        EXPECT_NE(expected, m);
+        inserter.flush();
+        EXPECT_EQ(expected, m);
+        inserter += std::vector<int>();
+        expected += std::vector<int>();
+    }
+    EXPECT_EQ(expected, m);
+
+    // Errors while flushing in the destructor are not propagated.
+    {
+        mdd::mdd_inserter<int> inserter(m);
+        inserter += std::vector<int>(3, 99);
+        mdd::mdd_factory<int>::memory_policy tight;
+        tight.byte_budget = 1;
+        factory.policy(tight);
+    }
+    factory.policy(mdd::mdd_factory<int>::memory_policy());
+    EXPECT_EQ(expected, m);
+
+    mdd::mdd_factory<bool> boolfactory;
+    mdd::mdd<bool> b = boolfactory.empty_set();
+    {
+        mdd::mdd_inserter<bool> inserter(b, 2);
+        inserter += std::vector<bool>{ true, false };
+        inserter += std::vector<bool>{ false };
+        inserter += std::vector<bool>{ true, false };
+    }
+    EXPECT_EQ(2, b.size());
+}
+
+/*
+ * Factory that can build the MDD of all vectors of a given length over a range of values,
+ * which has a number of vectors exponential in its number of nodes.
+ */
+class CubeFactory : public mdd::mdd_factory<int>
+{
+public:
+    set_type cube(int length, int values)
+    {
+        node_ptr level = emptylist();
+        for (int l = 0; l < length; ++l)
+        {
+            node_ptr list = empty();
+            for (int v = values - 1; v >= 0; --v)
+                list = create(v, list, level->use());
+            level->unuse();
+            level = list;
+        }
+        return set_type(this, level);
+    }
+};
+
+TEST_F(MDDTest, ExactCount)
+{
+    CubeFactory factory;
+    mdd::mdd<int> m = factory.cube(50, 3);
+    mdd::path_count expected = 1;
+    for (int i = 0; i < 50; ++i)
+        expected *= 3;
+    EXPECT_TRUE(expected == m.count());
+    EXPECT_TRUE(expected == m.count());
+    size_t nodes;
+    EXPECT_DOUBLE_EQ(double(expected), m.size(nodes));
+    EXPECT_EQ(50 * 3 + 2, nodes);
+
+    std::vector<int> v(51, 0);
+    m += v;
+    EXPECT_TRUE(expected + 1 == m.count());
+    m.remove_in_place(v.begin(), v.end());
+    v.pop_back();
+    m.remove_in_place(v.begin(), v.end());
+    EXPECT_TRUE(expected - 1 == m.count());
+
+    EXPECT_TRUE(1 == factory.singleton_set().count());
+    EXPECT_TRUE(0 == factory.empty_set().count());
+
+    // Memoized counts must not survive the removal of the nodes they belong to.
+    m = factory.empty_set();
+    factory.clean();
+    m = factory.cube(50, 2);
+    EXPECT_TRUE((mdd::path_count(1) << 50) == m.count());
+
+    mdd::mdd<int> huge = factory.cube(100, 4);
+    EXPECT_DOUBLE_EQ(std::pow(4.0, 100), huge.size());
+#ifdef __SIZEOF_INT128__
+    EXPECT_TRUE(std::numeric_limits<mdd::path_count>::max() == huge.count());
+#endif
+
+    // Long lists of siblings are not counted recursively, and fill more than one shard
+    // of the memo.
+    std::vector<std::vector<int> > wide;
+    for (int i = 0; i < 300000; ++i)
+        wide.push_back(std::vector<int>(1, i));
+    mdd::mdd<int> flat = factory.from_sorted(wide.begin(), wide.end());
+    EXPECT_TRUE(300000 == flat.count());
+    flat.remove_in_place(wide[0].begin(), wide[0].end());
+    EXPECT_TRUE(299999 == flat.count());
+}
+
+TEST_F(MDDTest, ForEach)
+{
+    mdd::mdd_factory<int> factory;
+    std::vector<std::vector<int> > all;
+    for (int i = 0; i < 300; ++i)
+        all.push_back({ i % 4, i % 9, i % 5 });
+    all.push_back({ });
+    all.push_back({ 1 });
+    std::sort(all.begin(), all.end());
+    mdd::mdd<int> m = factory.from_sorted(all.begin(), all.end());
+
+    std::vector<std::vector<int> > visited;
+    EXPECT_TRUE(m.for_each([&](const std::vector<int>& v) -> bool { visited.push_back(v); return true; }));
+    EXPECT_EQ(std::vector<std::vector<int> >(m.begin(), m.end()), visited);
+
+    size_t count = 0;
+    EXPECT_FALSE(m.for_each([&](const std::vector<int>&) { return ++count < 10; }));
+    EXPECT_EQ(10, count);
+
+    // Skip all vectors starting with 1, and stop at the first vector starting with 3.
+    visited.clear();
+    EXPECT_FALSE(m.for_each([&](const std::vector<int>& v) -> bool { visited.push_back(v); return true; },
+                            [](const std::vector<int>& prefix) -> mdd::visit_action {
+                                if (prefix[0] == 1)
+                                    return mdd::visit_skip;
+                                return prefix[0] == 3 ? mdd::visit_stop : mdd::visit_continue;
+                            }));
+    std::vector<std::vector<int> > expected;
+    for (auto& v : m)
+        if (!v.empty() && (v[0] == 0 || v[0] == 2))
+            expected.push_back(v);
+    EXPECT_EQ(expected, visited);
+}
+
+TEST_F(MDDTest, IteratorSeekAndReverse)
+{
+    mdd::mdd_factory<int> factory;
+    std::vector<std::vector<int> > all;
+    for (int i = 0; i < 200; ++i)
+        all.push_back({ i % 4 * 2, i % 9, i % 5 });
+    all.push_back({ });
+    all.push_back({ 2 });
+    all.push_back({ 2, 3 });
+    std::sort(all.begin(), all.end());
+    mdd::mdd<int> m = factory.from_sorted(all.begin(), all.end());
+    std::vector<std::vector<int> > forward(m.begin(), m.end());
+
+    std::vector<std::vector<int> > backward;
+    for (auto it = m.end(); it != m.begin();)
+        backward.push_back(*--it);
+    std::reverse(backward.begin(), backward.end());
+    EXPECT_EQ(forward, backward);
+
+    auto it = m.begin();
+    ++it; ++it;
+    EXPECT_EQ(forward[1], *--it);
+    EXPECT_EQ(forward[1], *it++);
+    EXPECT_EQ(forward[2], *it);
+
+    for (size_t i = 0; i < forward.size(); ++i)
+    {
+        auto& v = forward[i];
+        EXPECT_EQ(v, *m.lower_bound(v.begin(), v.end()));
+        auto next = m.upper_bound(v.begin(), v.end());
+        if (i + 1 < forward.size())
+            EXPECT_EQ(forward[i + 1], *next);
+        else
+            EXPECT_TRUE(next == m.end());
+    }
+    std::vector<int> key = { 3, 0, 0 };
+    EXPECT_EQ(forward[m.rank(key.begin(), key.end())], *m.lower_bound(key.begin(), key.end()));
+    key = { 2, 3, 7 };
+    EXPECT_EQ(forward[m.rank(key.begin(), key.end())], *m.upper_bound(key.begin(), key.end()));
+    key = { 9 };
+    EXPECT_EQ(forward.back(), *m.lower_bound(key.begin(), key.end())); // the empty vector
+    EXPECT_EQ(forward[forward.size() - 2], *--m.lower_bound(key.begin(), key.end()));
+    key = { 6, 7, 9 };
+    EXPECT_EQ(forward[m.rank(key.begin(), key.end())], *m.lower_bound(key.begin(), key.end()));
+    key = { 6, 9 };
+    m -= factory.singleton_set();
+    EXPECT_TRUE(m.end() == m.lower_bound(key.begin(), key.end()));
+}
+
+TEST_F(MDDTest, ExportColumns)
+{
+    mdd::mdd_factory<int> factory;
+    std::vector<std::vector<int> > all;
+    for (int i = 0; i < 1000; ++i)
+        all.push_back({ i % 4, i % 9, i % 5, i % 7 });
+    std::sort(all.begin(), all.end());
+    all.erase(std::unique(all.begin(), all.end()), all.end());
+    mdd::mdd<int> m = factory.from_sorted(all.begin(), all.end());
+
+    const size_t rows = all.size(), depth = 4;
+    for (unsigned threads : { 1, 3 })
+    {
+        std::vector<int> out(rows * depth, -1);
+        EXPECT_EQ(rows, m.export_columns(out.data(), out.size(), mdd::export_row_major, threads));
+        for (size_t r = 0; r < rows; ++r)
+            EXPECT_EQ(all[r], std::vector<int>(out.begin() + r * depth, out.begin() + (r + 1) * depth));
+
+        std::fill(out.begin(), out.end(), -1);
+        EXPECT_EQ(rows, m.export_columns(out.data(), out.size(), mdd::export_column_major, threads));
+        for (size_t r = 0; r < rows; ++r)
+            for (size_t c = 0; c < depth; ++c)
+                EXPECT_EQ(all[r][c], out[c * rows + r]);
+    }
+
+    std::vector<int> out(rows * depth);
+    EXPECT_THROW(m.export_columns(out.data(), out.size() - 1), std::length_error);
+    EXPECT_EQ(0, factory.empty_set().export_columns(out.data(), 0));
+    m += std::vector<int>({ 1, 2 });
+    out.resize(out.size() + depth);
+    EXPECT_THROW(m.export_columns(out.data(), out.size()), std::runtime_error);
+    EXPECT_THROW(m.export_columns(out.data(), out.size(), mdd::export_row_major, 4), std::runtime_error);
+}
+
+TEST_F(MDDTest, RankAndUnrank)
+{
+    mdd::mdd_factory<int> factory;
+    std::vector<std::vector<int> > all;
+    for (int i = 0; i < 300; ++i)
+        all.push_back({ i % 4, i % 9, i % 5 });
+    all.push_back({ });
+    all.push_back({ 1 });
+    all.push_back({ 1, 1 });
+    std::sort(all.begin(), all.end());
+    mdd::mdd<int> m = factory.from_sorted(all.begin(), all.end());
+
+    mdd::path_count index = 0;
+    for (auto it = m.begin(); it != m.end(); ++it, ++index)
+    {
+        EXPECT_EQ(*it, m.at(index));
+        EXPECT_TRUE(index == m.rank((*it).begin(), (*it).end()));
+    }
+    EXPECT_TRUE(index == m.count());
+    EXPECT_THROW(m.at(index), std::out_of_range);
+
+    // Vectors that are not in the set are ranked among the others.
+    std::vector<int> missing = { 1, 2, 7 };
+    mdd::path_count r = m.rank(missing.begin(), missing.end());
+    EXPECT_FALSE(m.contains(missing.begin(), missing.end()));
+    EXPECT_TRUE(missing < m.at(r));
+    EXPECT_TRUE(m.at(r - 1) < missing);
+
+    CubeFactory cubes;
+    mdd::mdd<int> cube = cubes.cube(70, 3);
+    mdd::path_count middle = cube.count() / 2;
+    std::vector<int> v = cube.at(middle);
+    EXPECT_TRUE(middle == cube.rank(v.begin(), v.end()));
+    EXPECT_EQ(std::vector<int>(70, 2), cube.at(cube.count() - 1));
+}
+
+TEST_F(MDDTest, Sample)
+{
+    mdd::mdd_factory<int> factory;
+    std::vector<std::vector<int> > all = { { }, { 0, 1 }, { 0, 2, 5 }, { 1 }, { 3, 3 } };
+    mdd::mdd<int> m = factory.from_sorted(all.begin(), all.end());
+    std::mt19937_64 rng(42);
+    std::map<std::vector<int>, int> histogram;
+    for (auto& v : m.sample(rng, 5000))
+    {
+        EXPECT_TRUE(std::binary_search(all.begin(), all.end(), v));
+        ++histogram[v];
+    }
+    EXPECT_EQ(all.size(), histogram.size());
+    for (auto& h : histogram)
+    {
+        EXPECT_LT(800, h.second);
+        EXPECT_GT(1200, h.second);
+    }
+    EXPECT_THROW(factory.empty_set().sample(rng, 1), std::runtime_error);
+
+    CubeFactory cubes;
+    mdd::mdd<int> cube = cubes.cube(80, 3);
+    for (auto& v : cube.sample(rng, 10))
+    {
+        EXPECT_EQ(80, v.size());
+        EXPECT_TRUE(cube.contains(v.begin(), v.end()));
+    }
+}
+
+#ifndef MDD_MARK_SWEEP
+TEST_F(MDDTest, IncrementalClean)
+{
+    mdd::mdd_factory<int> factory;
+    mdd::mdd<int> keep = factory.empty_set();
+    {
+        mdd::mdd<int> m = factory.empty_set();
+        for (int i = 0; i < 1000; ++i)
+        {
+            int v[3] = { i % 7, i % 13, i };
+            m.add_in_place(v, v + 3);
+            if (i % 10 == 0)
+                keep.add_in_place(v, v + 3);
+        }
+    }
+    factory.clean();
+    size_t live = factory.size();
+    {
+        mdd::mdd<int> m = keep;
+        for (int i = 0; i < 1000; ++i)
+        {
+            int v[3] = { i % 7, i % 13, i };
+            m.add_in_place(v, v + 3);
+        }
+    }
+    size_t total = factory.size();
+    EXPECT_LT(live, total);
+    EXPECT_EQ(10, factory.clean(10));
+    EXPECT_EQ(total - 10, factory.size());
+    while (factory.clean(100) != 0)
+        EXPECT_LE(live, factory.size());
+    EXPECT_EQ(live, factory.size());
+    EXPECT_EQ(100, keep.size());
+
+    // A node that dies after its parent must not be freed before it. Every node that
+    // print_nodes() mentions as a child must still be in the table.
+    {
+        int a[] = { 1, 2 }, b[] = { 5, 2 };
+        mdd::mdd<int> first = factory.empty_set(), second = factory.empty_set();
+        first.add_in_place(a, a + 2);
+        second.add_in_place(b, b + 2);
+        first = factory.empty_set();
+    }
+    while (factory.clean(1) != 0)
+    {
+        std::istringstream nodes(factory.print_nodes());
+        std::set<std::string> rows, children;
+        std::string line;
+        while (std::getline(nodes, line))
+        {
+            size_t open = line.find('('), comma = line.find(", ", open), next = line.find(", ", comma + 2);
+            rows.insert(line.substr(0, line.find_first_of("*+(")));
+            children.insert(line.substr(comma + 2, next - comma - 2));
+            children.insert(line.substr(next + 2, line.find(')') - next - 2));
+        }
+        children.erase("TRUE");
+        children.erase("FALSE");
+        for (auto& child: children)
+            EXPECT_EQ(1, rows.count(child)) << factory.print_nodes();
+    }
+    EXPECT_EQ(live, factory.size());
+}
+#endif // MDD_MARK_SWEEP
+
+TEST_F(MDDTest, MemoryPolicy)
+{
+    typedef mdd::mdd_factory<int> factory_type;
+    factory_type::memory_policy policy;
+    policy.byte_budget = 1;
+    {
+        factory_type factory(policy);
+        mdd::mdd<int> m = factory.empty_set();
+        int v[3] = { 1, 2, 3 };
+        EXPECT_THROW(m.add_in_place(v, v + 3), mdd::budget_exceeded);
+    }
+
+    size_t calls = 0;
+    policy.byte_budget = 200000;
+    policy.budget_callback = [&calls](size_t required) { ++calls; EXPECT_LT(200000, required); };
+    {
+        factory_type factory(policy);
+        mdd::mdd<int> m = factory.empty_set();
+        for (int i = 0; i < 10000; ++i)
+        {
+            int v[3] = { i % 7, i % 13, i };
+            m.add_in_place(v, v + 3);
+        }
+        EXPECT_EQ(10000, m.size());
+        EXPECT_LT(0, calls);
+    }
+
+    {
+        // An exceeded budget must not leave any nodes behind.
+        factory_type factory;
+        std::vector<mdd::mdd<int>> parts(20, factory.empty_set());
+        for (int i = 0; i < 20000; ++i)
+        {
+            int v[3] = { i % 7, i % 13, i };
+            parts[i % 20].add_in_place(v, v + 3);
+        }
+        factory_type::memory_policy tight;
+        tight.byte_budget = factory.bytes();
+        factory.policy(tight);
+        mdd::mdd<int> m = factory.empty_set();
+        EXPECT_THROW(for (auto& part: parts) m |= part, mdd::budget_exceeded);
+        factory.policy(factory_type::memory_policy());
+        m = factory.empty_set();
+        parts.clear();
+        factory.clean();
+        EXPECT_EQ(0, factory.size());
+    }
+
+#if !defined(MDD_THREAD_SAFE) && !defined(MDD_MARK_SWEEP)
+    factory_type::memory_policy gc;
+    gc.dead_ratio = 0.5;
+    gc.cache_node_limit = 1000;
+    factory_type plain, managed(gc);
+    size_t plain_max = 0, managed_max = 0;
+    {
+        mdd::mdd<int> m = plain.empty_set(), n = managed.empty_set();
+        for (int i = 0; i < 5000; ++i)
+        {
+            int v[3] = { i % 7, i % 13, i };
+            m.add_in_place(v, v + 3);
+            n.add_in_place(v, v + 3);
+            plain_max = std::max(plain_max, plain.size());
+            managed_max = std::max(managed_max, managed.size());
+        }
+        int v[3] = { 2, 9, 100 };
+        EXPECT_EQ(5000, n.size());
+        EXPECT_TRUE(n.contains(v, v + 3));
+    }
+    EXPECT_GT(plain_max / 2, managed_max);
+#endif
+#ifdef MDD_THREAD_SAFE
+    factory_type::memory_policy gc;
+    gc.dead_ratio = 0.5;
+    EXPECT_THROW(factory_type bad(gc), std::invalid_argument);
+    factory_type plain;
+    EXPECT_THROW(plain.policy(gc), std::invalid_argument);
+#endif
+}
+
+#ifdef MDD_MARK_SWEEP
+TEST_F(MDDTest, MarkSweepCollection)
+{
+    mdd::mdd_factory<int> factory;
+    factory.gc_threshold(1000);
+    mdd::mdd<int> m = factory.empty_set();
+    mdd::mdd<int> odd = factory.empty_set();
+    for (int i = 0; i < 5000; ++i)
+    {
+        int v[3] = { i % 7, i % 13, i };
+        m.add_in_place(v, v + 3);
+        if (i % 2)
+            odd.add_in_place(v, v + 3);
+        EXPECT_GT(2 * 1000 + 4 * 5000, factory.size());
+    }
+    mdd::mdd<int> even = m - odd;
+    EXPECT_EQ(5000, m.size());
+    EXPECT_EQ(2500, even.size());
+    EXPECT_EQ(m, even | odd);
+    for (int i = 0; i < 5000; ++i)
+    {
+        int v[3] = { i % 7, i % 13, i };
+        EXPECT_TRUE(m.contains(v, v + 3));
+        EXPECT_EQ(i % 2 == 0, even.contains(v, v + 3));
+    }
+}
+#endif // MDD_MARK_SWEEP
+
+#ifdef MDD_THREAD_SAFE
+TEST_F(MDDTest, ConcurrentOperations)
+{
+    const int threads = 4;
+    mdd::mdd_factory<int> factory;
+    {
+        mdd::mdd<int> shared = factory.empty_set();
+        for (int i = 0; i < 1000; ++i)
+        {
+            int v[3] = { i % 5, i % 11, i };
+            shared.add_in_place(v, v + 3);
+        }
+
+        std::vector<mdd::mdd<int> > results(threads, factory.empty_set());
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.push_back(std::thread([&, t]()
+            {
+                for (int round = 0; round < 20; ++round)
+                {
+                    mdd::mdd<int> m = factory.empty_set();
+                    for (int i = 0; i < 500; ++i)
+                    {
+                        int v[3] = { i % 5, i % 7, i + round };
+                        m.add_in_place(v, v + 3);
+                    }
+                    results[t] = (m | shared) - (m & shared);
+                }
+            }));
+        }
+        for (auto& w: workers)
+            w.join();
+
+        mdd::mdd<int> m = factory.empty_set();
+        for (int i = 0; i < 500; ++i)
+        {
+            int v[3] = { i % 5, i % 7, i + 19 };
+            m.add_in_place(v, v + 3);
+        }
+        mdd::mdd<int> expected = (m | shared) - (m & shared);
+        for (auto& r: results)
+            EXPECT_EQ(expected, r);
+    }
+    factory.clear_cache();
+    factory.clean();
+    EXPECT_EQ(0, factory.size());
+}
+#endif // MDD_THREAD_SAFE
+
 TEST_F(MDDTest, SetUnion)
 {
     mdd::mdd_factory<std::string> strfactory;
@@ -170,6 +800,28 @@ TEST_F(MDDTest, RelNext)
     EXPECT_EQ(0, strfactory.size()) << strfactory.print_nodes();
 }
 
+TEST_F(MDDTest, RelForEachPair)
+{
+    mdd::mdd_factory<int> factory;
+    std::set<std::pair<std::vector<int>, std::vector<int> > > expected, visited;
+    mdd::mdd_irel<int> r = factory.empty_irel();
+    for (int i = 0; i < 100; ++i)
+    {
+        std::vector<int> src = { i % 3, i % 7, i % 4 }, dst = { i % 5, i % 2, i % 3 };
+        r.add_in_place(src.begin(), src.end(), dst.begin(), dst.end());
+        expected.insert(std::make_pair(src, dst));
+    }
+    EXPECT_TRUE(r.for_each_pair([&](const std::vector<int>& src, const std::vector<int>& dst) -> bool {
+        EXPECT_TRUE(visited.insert(std::make_pair(src, dst)).second);
+        return true;
+    }));
+    EXPECT_EQ(expected, visited);
+
+    size_t count = 0;
+    EXPECT_FALSE(r.for_each_pair([&](const std::vector<int>&, const std::vector<int>&) { return ++count < 5; }));
+    EXPECT_EQ(5, count);
+}
+
 TEST_F(MDDTest, PartialRelNext)
 {
     mdd::mdd_factory<int> strfactory;
@@ -221,6 +873,163 @@ TEST_F(MDDTest, PartialRelNext)
     EXPECT_EQ(0, strfactory.size()) << strfactory.print_nodes();
 }
 
+TEST_F(MDDTest, Reachability)
+{
+    // Three counters from 0 to 4, each of which can be incremented on its own.
+    mdd::mdd_factory<int> factory;
+    mdd::projection_factory projfactory;
+    std::vector<mdd::projection> projections;
+    std::vector<mdd::mdd_irel<int> > relations;
+    for (size_t level = 0; level < 3; ++level)
+    {
+        projections.push_back(projfactory.create(&level, &level + 1, 3));
+        relations.push_back(factory.empty_irel());
+        for (int v = 0; v < 4; ++v)
+        {
+            int w = v + 1;
+            relations.back().add_in_place(&v, &v + 1, &w, &w + 1);
+        }
+    }
+    std::vector<int> zero(3, 0);
+    mdd::mdd<int> initial = factory.empty_set() + zero;
+
+    for (auto strategy : { mdd::reach_bfs, mdd::reach_chaining })
+    {
+        for (auto image : { mdd::image_frontier, mdd::image_full })
+        {
+            mdd::reachability<int> reach(strategy, image);
+            for (size_t i = 0; i < 3; ++i)
+                reach.add(relations[i], projections[i]);
+            mdd::mdd<int> reached = reach(initial);
+            EXPECT_EQ(125, reached.size());
+            EXPECT_TRUE(125 == reach.statistics().back().states);
+            if (strategy == mdd::reach_bfs)
+                EXPECT_EQ(13, reach.statistics().size());
+            else
+                EXPECT_GT(13, reach.statistics().size());
+        }
+    }
+
+    // Saturation finds the same states. A second run with the same partitions is answered
+    // from the operation cache.
+    mdd::reachability<int> saturation(mdd::reach_saturation);
+    for (size_t i = 3; i-- > 0;)
+        saturation.add(relations[i], projections[i]);
+    EXPECT_EQ(125, saturation(initial).size());
+    EXPECT_EQ(1, saturation.statistics().size());
+    EXPECT_TRUE(125 == saturation.statistics().back().states);
+    EXPECT_EQ(125, saturation(initial).size());
+    EXPECT_EQ(0, saturation.statistics().back().cache_misses);
+
+    // Cache keys that do not fit are rejected rather than shared.
+    typedef mdd::mdd_factory<int>::parent::mdd_rel_saturate saturate;
+    EXPECT_NE(saturate::key(1, 2), saturate::key(2, 1));
+    EXPECT_THROW(saturate::key(1, size_t(1) << 32), std::overflow_error);
+    EXPECT_THROW(saturate::key(saturate::key_type(1) << 32, 0), std::overflow_error);
+
+    // Without projections, the relation only applies to vectors of its own length.
+    mdd::reachability<int> reach(mdd::reach_bfs);
+    reach.add(relations[0]);
+    mdd::mdd<int> start = factory.empty_set() + std::vector<int>(1, 0);
+    EXPECT_EQ(5, reach(start).size());
+    EXPECT_EQ(5, reach.statistics().size());
+    EXPECT_TRUE(0 == reach.statistics().front().states);
+
+    // Every iteration is measured when asked for.
+    reach.collect_statistics(true);
+    EXPECT_EQ(5, reach(start).size());
+    EXPECT_TRUE(2 == reach.statistics().front().states);
+    EXPECT_LT(0, reach.statistics().front().set_nodes);
+    EXPECT_TRUE(5 == reach.statistics().back().states);
+}
+
+TEST_F(MDDTest, RelNextFused)
+{
+    // Random relations and sets of vectors of length 3 over 0..3, where the relation
+    // changes the first and last level.
+    mdd::mdd_factory<int> factory;
+    mdd::projection_factory projfactory;
+    size_t levels[] = { 0, 2 };
+    mdd::projection proj = projfactory.create(levels, levels + 2, 3);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> value(0, 3);
+    for (int round = 0; round < 20; ++round)
+    {
+        mdd::mdd_irel<int> full = factory.empty_irel(), partial = factory.empty_irel();
+        mdd::mdd<int> s = factory.empty_set(), v = factory.empty_set();
+        for (int i = 0; i < 12; ++i)
+        {
+            int a[3], b[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                a[j] = value(rng);
+                b[j] = value(rng);
+            }
+            full.add_in_place(a, a + 3, b, b + 3);
+            partial.add_in_place(a, a + 2, b, b + 2);
+            s += std::vector<int>(a, a + 3);
+            v += std::vector<int>(b, b + 3);
+        }
+
+        EXPECT_EQ(v | full(s), full.next_union(s, v));
+        EXPECT_EQ(full(s) - v, full.next_minus(s, v));
+        EXPECT_EQ(v | partial(s, proj), partial.next_union(s, v, proj));
+        EXPECT_EQ(partial(s, proj) - v, partial.next_minus(s, v, proj));
+        EXPECT_EQ(full(s), full.next_union(s, factory.empty_set()));
+        EXPECT_EQ(factory.empty_set(), full.next_minus(s, s | full(s)));
+    }
+}
+
+TEST_F(MDDTest, RelNextMulti)
+{
+    // One partition per pair of adjacent levels, plus one over all levels, on random
+    // vectors of length 4 over 0..2.
+    mdd::mdd_factory<int> factory;
+    mdd::projection_factory projfactory;
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> value(0, 2);
+    std::vector<std::pair<mdd::mdd_irel<int>, mdd::projection> > partitions;
+    for (size_t level = 0; level < 3; ++level)
+    {
+        size_t levels[] = { level, level + 1 };
+        partitions.push_back(std::make_pair(factory.empty_irel(), projfactory.create(levels, levels + 2, 4)));
+    }
+    partitions.push_back(std::make_pair(factory.empty_irel(), projfactory.create(4)));
+    mdd::mdd<int> s = factory.empty_set();
+    for (int i = 0; i < 40; ++i)
+    {
+        int a[4], b[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            a[j] = value(rng);
+            b[j] = value(rng);
+        }
+        partitions[i % 4].first.add_in_place(a, a + (i % 4 == 3 ? 4 : 2), b, b + (i % 4 == 3 ? 4 : 2));
+        s += std::vector<int>(a, a + 4);
+    }
+
+    mdd::mdd<int> expected = factory.empty_set();
+    for (auto it = partitions.begin(); it != partitions.end(); ++it)
+        expected |= it->first(s, it->second);
+    EXPECT_NE(factory.empty_set(), expected);
+    EXPECT_EQ(expected, s.next(partitions));
+    EXPECT_EQ(factory.empty_set(), s.next(std::vector<std::pair<mdd::mdd_irel<int>, mdd::projection> >()));
+
+    // Breadth-first search leaves the visited states out while walking the partitions, and
+    // must find the same states as chaining.
+    mdd::reachability<int> bfs(mdd::reach_bfs), chaining(mdd::reach_chaining);
+    for (auto it = partitions.begin(); it != partitions.end(); ++it)
+    {
+        bfs.add(it->first, it->second);
+        chaining.add(it->first, it->second);
+    }
+    mdd::mdd<int> initial = factory.empty_set() + std::vector<int>(4, 0);
+    mdd::mdd<int> reached = chaining(initial);
+    EXPECT_NE(initial, reached);
+    EXPECT_EQ(reached, bfs(initial));
+    EXPECT_EQ(chaining(s), bfs(s));
+}
+
 TEST_F(MDDTest, RelPrev)
 {
     mdd::mdd_factory<int> strfactory;
@@ -247,6 +1056,81 @@ TEST_F(MDDTest, RelPrev)
 
         EXPECT_EQ(s2, r.pre(s1));
     }
+    {
+        // A partial relation on levels 0 and 2 of vectors of length 3, against the same
+        // relation expanded to full width.
+        mdd::projection_factory projfactory;
+        size_t levels[] = { 0, 2 };
+        mdd::projection proj = projfactory.create(levels, levels + 2, 3);
+        int R[3][2][2] = { { {0, 0}, {1, 1} },
+                           { {1, 2}, {2, 0} },
+                           { {0, 0}, {2, 2} } };
+        int S[3][3] = { {1, 0, 1},
+                        {2, 1, 0},
+                        {2, 2, 1} };
+        mdd::mdd_irel<int> partial = strfactory.empty_irel(), full = strfactory.empty_irel();
+        mdd::mdd<int> s = strfactory.empty_set();
+        for (auto v: R)
+        {
+            partial.add_in_place(v[0], v[0] + 2, v[1], v[1] + 2);
+            for (int middle = 0; middle < 3; ++middle)
+            {
+                int src[] = { v[0][0], middle, v[0][1] }, dst[] = { v[1][0], middle, v[1][1] };
+                full.add_in_place(src, src + 3, dst, dst + 3);
+            }
+        }
+        for (auto v: S)
+            s.add_in_place(v, v + 3);
+
+        int P[2][3] = { {0, 0, 0},
+                        {1, 1, 2} };
+        mdd::mdd<int> expected = strfactory.empty_set();
+        for (auto v: P)
+            expected.add_in_place(v, v + 3);
+        EXPECT_EQ(expected, partial.pre(s, proj));
+        EXPECT_EQ(full.pre(s), partial.pre(s, proj));
+
+        // The pair of empty vectors relates every state to itself.
+        partial.add_in_place(S[0], S[0], S[0], S[0]);
+        EXPECT_EQ(expected | s, partial.pre(s, proj));
+    }
+    {
+        // The empty pair after several others, with states below and above the first
+        // value of the relation.
+        mdd::projection_factory projfactory;
+        size_t levels[] = { 0, 2 };
+        mdd::projection proj = projfactory.create(levels, levels + 2, 3);
+        int R[2][2][2] = { { {1, 0}, {1, 1} },
+                           { {2, 0}, {2, 1} } };
+        int S[3][3] = { {0, 0, 0},
+                        {1, 2, 1},
+                        {2, 0, 1} };
+        mdd::mdd_irel<int> partial = strfactory.empty_irel(), full = strfactory.empty_irel();
+        mdd::mdd<int> s = strfactory.empty_set();
+        for (auto v: R)
+        {
+            partial.add_in_place(v[0], v[0] + 2, v[1], v[1] + 2);
+            for (int middle = 0; middle < 3; ++middle)
+            {
+                int src[] = { v[0][0], middle, v[0][1] }, dst[] = { v[1][0], middle, v[1][1] };
+                full.add_in_place(src, src + 3, dst, dst + 3);
+            }
+        }
+        partial.add_in_place(S[0], S[0], S[0], S[0]);
+        for (auto v: S)
+            s.add_in_place(v, v + 3);
+
+        int P[5][3] = { {0, 0, 0},
+                        {1, 2, 0},
+                        {1, 2, 1},
+                        {2, 0, 0},
+                        {2, 0, 1} };
+        mdd::mdd<int> expected = strfactory.empty_set();
+        for (auto v: P)
+            expected.add_in_place(v, v + 3);
+        EXPECT_EQ(expected, partial.pre(s, proj));
+        EXPECT_EQ(full.pre(s) | s, partial.pre(s, proj));
+    }
     strfactory.clear_cache();
     strfactory.clean();
     EXPECT_EQ(0, strfactory.size()) << strfactory.print_nodes();
@@ -558,16 +1442,233 @@ TEST_F(MDDTest, Projection)
     EXPECT_EQ(4, v.size());
 }
 
-TEST(Randoms, CacheRecord)
+TEST(Randoms, NodeCache)
+{
+    typedef mdd::node<int> node_t;
+    mdd::node_factory<int> f;
+    mdd::cache_config config;
+    for (int op = 0; op < mdd::cache_operation_count; ++op)
+        config.size[op] = 4;
+    mdd::node_cache<node_t> cache(config, &f.generation());
+    const node_t* e = f.empty();
+    const node_t* l = f.emptylist();
+    const node_t* result;
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_union, e, l, result));
+    cache.store(mdd::cache_set_union, e, l, l);
+    EXPECT_TRUE(cache.lookup(mdd::cache_set_union, e, l, result));
+    EXPECT_EQ(l, result);
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_minus, e, l, result));
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_union, l, e, result));
+
+    // Operands that are not nodes are part of the key.
+    EXPECT_FALSE(cache.lookup(mdd::cache_rel_saturate, e, nullptr, nullptr, nullptr, 1, result));
+    cache.store(mdd::cache_rel_saturate, e, nullptr, nullptr, nullptr, 1, l);
+    EXPECT_FALSE(cache.lookup(mdd::cache_rel_saturate, e, nullptr, nullptr, nullptr, 2, result));
+    EXPECT_TRUE(cache.lookup(mdd::cache_rel_saturate, e, nullptr, nullptr, nullptr, 1, result));
+    EXPECT_EQ(l, result);
+
+#ifndef MDD_MARK_SWEEP
+    // Results that are no longer referenced are revived, until nodes are removed.
+    const node_t* n = f.create(1, e, f.create(2, e, l));
+    cache.store(mdd::cache_set_minus, l, l, n);
+    n->unuse();
+    EXPECT_TRUE(cache.lookup(mdd::cache_set_minus, l, l, result));
+    EXPECT_EQ(n, result);
+    f.clean();
+    EXPECT_EQ(2, f.size());
+    EXPECT_TRUE(cache.lookup(mdd::cache_set_minus, l, l, result));
+    result->unuse();
+    result->unuse();
+    EXPECT_EQ(2, f.clean(10));
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_minus, l, l, result));
+#endif
+
+    // Freeing the nodes of another factory leaves the cache valid.
+    cache.store(mdd::cache_set_union, e, l, l);
+    mdd::node_factory<int> g;
+    g.create(1, g.empty(), g.emptylist())->unuse();
+    EXPECT_EQ(1, g.clean(10));
+    EXPECT_TRUE(cache.lookup(mdd::cache_set_union, e, l, result));
+    EXPECT_EQ(l, result);
+
+    // Misses that are never stored are forgotten when their scope ends. A store without a
+    // lookup does not take their frames.
+    size_t computing = mdd::node_cache<node_t>::computing();
+    {
+        mdd::node_cache<node_t>::scope scope;
+        EXPECT_FALSE(cache.lookup(mdd::cache_set_intersection, e, l, result));
+        cache.store(mdd::cache_set_intersection, l, e, l);
+        EXPECT_EQ(computing + 1, mdd::node_cache<node_t>::computing());
+    }
+    EXPECT_EQ(computing, mdd::node_cache<node_t>::computing());
+    mdd::mdd_factory<int> h;
+    mdd::mdd<int> x = h.empty_set(), y = h.empty_set();
+    x += std::vector<int>{ 1, 2 };
+    y += std::vector<int>{ 1, 3 };
+    EXPECT_EQ(2, (x | y).size());
+    EXPECT_EQ(computing, mdd::node_cache<node_t>::computing());
+
+    cache.clear();
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_union, e, l, result));
+}
+
+TEST(Randoms, CachePartitions)
+{
+    mdd::cache_config config;
+    config.size[mdd::cache_set_union] = 0;
+    config.work_threshold[mdd::cache_set_minus] = 1000000;
+    config.size[mdd::cache_set_intersection] = 64;
+    config.min_size = 16;
+    mdd::mdd_factory<int> factory(mdd::mdd_factory<int>::memory_policy(), config);
+    mdd::mdd<int> a = factory.empty_set(), b = factory.empty_set();
+    for (int i = 0; i < 200; ++i)
+    {
+        int v[2] = { i % 10, i };
+        a.add_in_place(v, v + 2);
+        v[0] = 2 * i % 10;
+        v[1] = 2 * i;
+        b.add_in_place(v, v + 2);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(300, (a | b).size());
+        EXPECT_EQ(100, (a - b).size());
+        EXPECT_EQ(100, (a & b).size());
+    }
+    // Caching is bypassed, or results do not take enough work to be stored.
+    EXPECT_EQ(0, factory.cache_hits(mdd::cache_set_union));
+    EXPECT_EQ(0, factory.cache_misses(mdd::cache_set_union));
+    EXPECT_EQ(0, factory.cache_capacity(mdd::cache_set_union));
+    EXPECT_EQ(0, factory.cache_hits(mdd::cache_set_minus));
+    EXPECT_LT(0, factory.cache_hits(mdd::cache_set_intersection));
+    EXPECT_EQ(64, factory.cache_capacity(mdd::cache_set_intersection));
+    // Intersections that are never repeated make the partition shrink.
+    for (int i = 0; i < 1000; ++i)
+    {
+        int v[2] = { i % 10, i };
+        mdd::mdd<int> c = factory.empty_set();
+        c.add_in_place(v, v + 2);
+        EXPECT_EQ(i < 200 ? 1 : 0, (a & c).size());
+    }
+    EXPECT_EQ(16, factory.cache_capacity(mdd::cache_set_intersection));
+
+    // Entries are kept when a partition grows.
+    typedef mdd::node<int> node_t;
+    mdd::node_factory<int> f;
+    config.min_size = 4;
+    config.size[mdd::cache_set_union] = 4;
+    mdd::node_cache<node_t> cache(config, &f.generation());
+    std::vector<const node_t*> nodes;
+    const node_t* result;
+    for (int i = 0; cache.capacity(mdd::cache_set_union) == 4; ++i)
+    {
+        ASSERT_GT(1000, i);
+        nodes.push_back(f.create(i, f.empty(), f.emptylist()));
+        EXPECT_FALSE(cache.lookup(mdd::cache_set_union, nodes.back(), f.empty(), result));
+        cache.store(mdd::cache_set_union, nodes.back(), f.empty(), nodes.back());
+        EXPECT_TRUE(cache.lookup(mdd::cache_set_union, nodes.back(), f.empty(), result));
+        result->unuse();
+    }
+    EXPECT_TRUE(cache.lookup(mdd::cache_set_union, nodes.back(), f.empty(), result));
+    EXPECT_EQ(nodes.back(), result);
+    result->unuse();
+    for (auto node: nodes)
+        node->unuse();
+}
+
+TEST(Randoms, VictimCache)
 {
-    typedef mdd::cacherecord<mdd::node<int> > rectype;
+    typedef mdd::node<int> node_t;
     mdd::node_factory<int> f;
-    rectype rec1(mdd::cache_set_union, f.empty(), f.empty(), nullptr);
-    rectype rec2(rec1);
-    rectype rec3(mdd::cache_set_union, f.emptylist(), f.emptylist(), nullptr);
-    rec2.make_clear_operation();
-    EXPECT_EQ(rectype::hash()(rec1), rectype::hash()(rec2));
-    EXPECT_EQ(true, rectype::equal()(rec2, rec3));
+    mdd::cache_config config;
+    config.adaptive = false;
+    config.size[mdd::cache_set_union] = 2;
+    config.size[mdd::cache_rel_next] = 2;
+    config.victim_size = 4;
+    mdd::node_cache<node_t> cache(config, &f.generation());
+    std::vector<const node_t*> nodes;
+    for (int i = 0; i < 100; ++i)
+        nodes.push_back(f.create(i, f.empty(), f.emptylist()));
+    const node_t* e = f.empty();
+    const node_t* result;
+
+    // An expensive result, that took three misses to compute.
+    EXPECT_FALSE(cache.lookup(mdd::cache_rel_next, nodes[0], e, result));
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_union, nodes[1], e, result));
+    cache.store(mdd::cache_set_union, nodes[1], e, e);
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_union, nodes[2], e, result));
+    cache.store(mdd::cache_set_union, nodes[2], e, e);
+    cache.store(mdd::cache_rel_next, nodes[0], e, nodes[0]);
+
+    // Cheap results evict each other, but not the expensive one.
+    for (int i = 3; i < 100; ++i)
+    {
+        mdd::cache_operation op = i < 50 ? mdd::cache_rel_next : mdd::cache_set_union;
+        EXPECT_FALSE(cache.lookup(op, nodes[i], e, result));
+        cache.store(op, nodes[i], e, e);
+    }
+    EXPECT_FALSE(cache.lookup(mdd::cache_set_union, nodes[1], e, result));
+    EXPECT_TRUE(cache.lookup(mdd::cache_rel_next, nodes[0], e, result));
+    EXPECT_EQ(nodes[0], result);
+    EXPECT_EQ(1, cache.victim_hits());
+}
+
+TEST(Randoms, NodeLayout)
+{
+#ifdef MDD_COMPACT_NODES
+    // The count and both children are 32 bits wide.
+    EXPECT_GE(16, sizeof(mdd::node<int>));
+
+    // Children are found by their index in the arenas.
+    mdd::node_arena<mdd::node<int> > arena;
+    const mdd::node<int>* child = arena.create(0, nullptr, nullptr, 0);
+    mdd::node<int> parent(0, child, child, 0);
+    EXPECT_EQ(child, parent.right);
+    EXPECT_EQ(child, parent.down);
+    EXPECT_TRUE(parent.right->sentinel());
+    EXPECT_FALSE(parent.sentinel());
+
+#ifndef MDD_MARK_SWEEP
+    // A count that would reach the dead bit is refused, also in release builds.
+    parent.usecount = ~mdd::node<int>::dead_bit;
+    EXPECT_THROW(parent.use(), std::overflow_error);
+    EXPECT_EQ(~mdd::node<int>::dead_bit, parent.references());
+    parent.usecount = mdd::node<int>::dead_bit | ~mdd::node<int>::dead_bit;
+    EXPECT_THROW(parent.revive(), std::overflow_error);
+    EXPECT_NE(0, parent.usecount & mdd::node<int>::dead_bit);
+#endif
+#else
+    EXPECT_EQ(4 * sizeof(void*), sizeof(mdd::node<int>));
+#endif
+}
+
+TEST(Randoms, UniqueTable)
+{
+    typedef mdd::node<int> node_t;
+    std::deque<node_t> nodes;
+    for (int i = 0; i < 1000; ++i)
+        nodes.emplace_back(i, nullptr, nullptr, 0);
+    mdd::unique_table<node_t> table(16);
+    for (auto& n: nodes)
+    {
+        size_t slot, hash = node_t::hash()(&n);
+        EXPECT_EQ(nullptr, table.find(n.value, n.right, n.down, hash, slot));
+        table.insert(slot, hash, &n);
+    }
+    EXPECT_EQ(1000, table.size());
+    for (auto it = table.begin(); it != table.end();)
+    {
+        if ((*it)->value % 2)
+            it = table.erase(it);
+        else
+            ++it;
+    }
+    EXPECT_EQ(500, table.size());
+    for (auto& n: nodes)
+    {
+        size_t slot, hash = node_t::hash()(&n);
+        EXPECT_EQ(n.value % 2 ? nullptr : &n, table.find(n.value, n.right, n.down, hash, slot));
+    }
 }
 
 int main(int argc, char** argv)